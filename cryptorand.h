@@ -9,13 +9,14 @@ This uses the operating system's random number generation. If you're looking for
 scratch you'll need to look elsewhere.
 
 Supported generation methods are Win32's BCryptGenRandom() with CryptGenRandom() as a fallback. On
-platforms that support /dev/urandom, that will be used. OpenBSD will use arc4random().
+platforms that support /dev/urandom, that will be used. OpenBSD will use arc4random(), as will Linux
+with glibc 2.41 or newer on kernel 6.11 or newer where it's backed by the vDSO.
 
 There is no need to link to anything with this library. You can use CRYPTORAND_IMPLEMENTATION to
 define the implementation section, or you can use cryptorand.c if you prefer a traditional
 header/source pair.
 
-There's only three functions, all of which should be self explanatory and easy to figure out:
+There's only a handful of functions, all of which should be self explanatory and easy to figure out:
 
     ```
     cryptorand_result cryptorand_init(cryptorand* pRNG);
@@ -31,14 +32,278 @@ To generate random bytes you need only call `cryptorand_generate()`. You just sp
 a buffer that will receive the random data and the number of bytes you want. If this fails, the
 content of the buffer will be cleared to zero.
 
+Large requests to `cryptorand_generate()` are split into chunks internally to work around the size
+limits of the backend so there's no upper limit on the size of a single request.
+
 Uninitialize the random number generator with `cryptorand_uninit()`.
 
+If you need a huge amount of random data, such as when filling a disk, you can use
+`cryptorand_generate_stream()`. This generates data in chunks of `CRYPTORAND_STREAM_CHUNK_SIZE`
+bytes and passes each chunk to a callback so the full output never needs to be held in memory:
+
+    ```
+    cryptorand_result cryptorand_generate_stream(cryptorand* pRNG, cryptorand_uint64 byteCount, cryptorand_stream_proc onData, void* pUserData);
+    ```
+
+On POSIX platforms you can write random data straight to a file descriptor with
+`cryptorand_write_fd()`. The intermediary buffer is aligned to `CRYPTORAND_WRITE_ALIGNMENT` so it
+can be used with descriptors opened with `O_DIRECT`, in which case the byte count needs to be a
+multiple of the device's block size.
+
+The backend is selected at initialization time. You can plug in your own backend, such as a
+hardware module or a test double, with a `cryptorand_backend_vtable` and `cryptorand_init_ex()`:
+
+    ```
+    cryptorand_backend_vtable myBackend = { my_on_init, my_on_uninit, my_on_generate, NULL };
+    const cryptorand_backend_vtable* pBackends[] = { &myBackend };
+
+    cryptorand_config config = cryptorand_config_init();
+    config.ppCustomBackendVTables = pBackends;
+    config.customBackendCount     = 1;
+    config.pCustomBackendUserData = &myBackendState;
+
+    cryptorand_init_ex(&config, &rng);
+    ```
+
+Custom backends are tried in order. If none of them can be initialized it'll fall back to the stock
+backend for the platform. Any state needed by the backend should be stored in the user data pointer.
+The last member, `onReseed`, is optional and can be NULL.
+
+There is no RDRAND/RDSEED support, and this is intentional. This library does not have a userspace
+generator that could be seeded from it and the operating system already mixes the CPU's hardware
+generator into its own pool where it's available. If you really want to use it, or any other
+hardware source, you can do so with a custom backend.
+
+For small or static builds, define `CRYPTORAND_NO_STDIO` to read /dev/urandom with `open()` and
+`read()` rather than stdio. On Linux x86_64 and AArch64 you can instead define
+`CRYPTORAND_RAW_SYSCALLS` which calls `getrandom()` with inline syscalls and doesn't touch the C
+library at all in the backend. Like arc4random(), this blocks until the generator is ready.
+
+Small requests can be expensive because each one is a call into the operating system. To speed
+these up you can have the generator keep an internal buffer which small requests are served from:
+
+    ```
+    cryptorand_config config = cryptorand_config_init();
+    config.bufferSizeInBytes = 4096;
+
+    cryptorand_init_ex(&config, &rng);
+    ```
+
+Bytes are zeroed in the buffer as they're handed out. Requests that are at least as big as the buffer
+bypass it. On POSIX platforms the buffer is discarded in a child process after `fork()` so the parent
+and child never hand out the same bytes. A buffered generator is not thread safe regardless of the
+backend.
+
+If you define `CRYPTORAND_INLINE_FASTPATH` before including the header, `cryptorand_generate_inline()`
+becomes available. This is a static inline function that copies straight out of the buffer and only
+calls `cryptorand_generate()` when the buffer needs refilling, so small requests avoid the function
+call even without link time optimization.
+
+The buffer is allocated with `malloc()` by default. Use `allocationCallbacks` in the config to use
+your own allocator. You can also allocate the memory yourself by using `cryptorand_get_heap_size()`
+and `cryptorand_init_preallocated()`. In this case you're responsible for freeing the memory after
+`cryptorand_uninit()`. No memory is ever allocated after initialization.
+
+On POSIX platforms you can keep buffered data in locked memory with `cryptorand_secure_pool`. This
+maps one block of memory with guard pages, locks it with `mlock()`, excludes it from core dumps and
+wipes it in forked children where supported. The block is split into fixed size slots, one per
+generator, so the cost of setting it up is only paid once:
+
+    ```
+    cryptorand_get_heap_size(&config, &heapSizeInBytes);
+    cryptorand_secure_pool_init(heapSizeInBytes, maxGeneratorCount, &pool);
+
+    config.allocationCallbacks = cryptorand_secure_pool_get_allocation_callbacks(&pool);
+    cryptorand_init_ex(&config, &rng);
+    ```
+
+Set `enableHealthTests` in the config to run the output of the backend through the SP 800-90B
+repetition count and adaptive proportion tests. This will catch a source that has become stuck, such
+as reading zeros from something that isn't really a random device. When a test fails,
+`CRYPTORAND_HEALTH_FAILURE` is returned and the generator will keep failing until it's reinitialized.
+
+You can see what a generator has been doing with `cryptorand_get_stats()`. This returns the number
+of calls, the number of bytes generated, how many times the backend was called, reseeds and how many
+times things failed. The counters are updated atomically so they're accurate even when a generator
+is shared between threads, and they're safe to read while other threads are using it. Set
+`enableLatencyHistogram` in the config to also get a histogram of how long calls into the backend
+took, and `onStats` to have the counters pushed to you after each call into the backend, which is
+useful for feeding a metrics pipeline.
+
+For lower level tracing you can define `CRYPTORAND_ENABLE_USDT` before the implementation to compile
+in USDT probes for use with bpftrace and friends. This requires `<sys/sdt.h>`. The probes are
+`init`, `backend_generate_entry`, `backend_generate_exit`, `buffer_refill`, `reseed`,
+`health_failure` and `error`, all under the `cryptorand` provider. The `reseed` probe fires for
+`cryptorand_reseed()` and for prediction resistant requests. See `tests/cryptorand_usdt.bt` for an
+example.
+
+When compiling as C++11 or newer there is a small C++ wrapper called `cryptorand_cpp::engine`. This
+satisfies the UniformRandomBitGenerator requirements so it can be used with the standard library's
+distributions and algorithms like `std::shuffle()`:
+
+    ```
+    cryptorand_cpp::engine rng;
+    std::uniform_int_distribution<int> dist(1, 6);
+    int roll = dist(rng);
+    ```
+
+The engine keeps its own buffer of `CRYPTORAND_ENGINE_BUFFER_SIZE` bytes so most calls do not need
+to go to the backend. For things like nonces and keys where the size is known at compile time, use
+`generate<N>()` or `generate<T>()`. These compile down to a fixed size copy out of the buffer. For C,
+`CRYPTORAND_GENERATE_OBJECT(pRNG, pObject)` will fill an object using `sizeof`. Define
+`CRYPTORAND_NO_CPP` to disable the wrapper.
+
+For simulations and the like there are some helpers for sampling from non-uniform distributions:
+
+    ```c
+    double samples[1024];
+    cryptorand_normal_f64_array(&rng, samples, 1024);       // Mean 0, standard deviation 1.
+    cryptorand_exponential_f64_array(&rng, samples, 1024);  // Rate 1.
+    ```
+
+These use a Ziggurat with 256 layers and the uniform inputs are generated in blocks, so it's much
+faster to fill one large array than to call these once per sample. They don't depend on the math
+library.
+
+For weighted selection from a fixed set of outcomes, build an alias table once and then draw
+indices from it in constant time:
+
+    ```c
+    cryptorand_alias_table table;
+    cryptorand_alias_table_build(pWeights, weightCount, NULL, &table);
+
+    cryptorand_alias_sample_batch(&rng, &table, pIndices, indexCount);
+
+    cryptorand_alias_table_uninit(&table);
+    ```
+
+The memory for the table can be allocated by the application with
+`cryptorand_alias_table_get_heap_size()` and `cryptorand_alias_table_build_preallocated()`.
+
+To visit a range of indices in a random order without storing the order, use a permutation. This
+maps `[0, count)` onto itself and works with ranges far too big to shuffle in memory:
+
+    ```c
+    cryptorand_permutation permutation;
+    cryptorand_permutation_init(&rng, count, &permutation);
+
+    for (i = 0; i < count; i += 1) {
+        visit(cryptorand_permutation_permute(&permutation, i));
+    }
+    ```
+
+The mapping can be reversed with `cryptorand_permutation_inverse()` and many indices can be mapped
+at once with `cryptorand_permutation_permute_batch()`. This is for randomizing order only and is not
+a substitute for a real block cipher.
+
+For things like elliptic curve scalars and RSA blinding factors there's `cryptorand_bigint_below()`
+which generates a uniform big-endian integer below an arbitrary bound. The comparisons are done in
+constant time. Scalars for common curves can be generated with `cryptorand_scalar_p256()`,
+`cryptorand_scalar_secp256k1()` and `cryptorand_scalar_curve25519()`, which output 32 bytes in the
+range [1, n).
+
+Random strings for things like invite codes can be generated from any alphabet of up to 256
+characters with `cryptorand_string()`. For passphrases made up of words from a list, use
+`cryptorand_passphrase()` which also tells you how many bits of entropy the passphrase has:
+
+    ```c
+    char code[8];
+    cryptorand_string(&rng, "23456789ABCDEFGHJKLMNPQRSTUVWXYZ", 32, code, sizeof(code));  // Not null terminated.
+
+    char passphrase[256];
+    double entropyBits;
+    cryptorand_passphrase(&rng, ppWordList, wordListCount, 6, " ", passphrase, sizeof(passphrase), &entropyBits);
+    ```
+
+For AEAD ciphers like AES-GCM and ChaCha20-Poly1305 there's a nonce generator which combines a
+random prefix with a counter. This is much cheaper than generating every nonce from scratch and
+guarantees that nonces don't repeat, rather than relying on the birthday bound:
+
+    ```c
+    cryptorand_nonce_generator nonces;
+    cryptorand_nonce_generator_init(&rng, 12, &nonces);   // Or 24 for XChaCha20-Poly1305.
+
+    unsigned char nonce[12];
+    cryptorand_nonce_generator_next(&nonces, nonce);
+    ```
+
+A new prefix is drawn when the counter runs out and after fork(). Use one nonce generator per
+thread.
+
+If you need many generators, such as one per connection, you can derive them from a parent with
+`cryptorand_derive()`. Derived generators share the parent's backend so they're cheap to create,
+but have their own buffer, health tests and statistics:
+
+    ```c
+    cryptorand connectionRNG;
+    cryptorand_derive(&rng, &config, &connectionRNG);
+    ```
+
+Every derived generator still reads directly from the operating system so they're all independent
+of each other. The parent must outlive its children.
+
+Initialization can be deferred until the generator is first used by zero initializing it with
+`CRYPTORAND_STATIC_INIT` rather than calling `cryptorand_init()`. This is thread safe. If you just
+want a generator and don't care about configuring it, use the process wide default instance. This
+saves every library in the process from opening its own handle:
+
+    ```c
+    cryptorand_generate(cryptorand_default(), pBuffer, bufferSizeInBytes);
+    ```
+
+Early in boot, or in a freshly started virtual machine, the operating system may not have seeded
+its generator yet. The /dev/urandom backend doesn't wait for this and arc4random() blocks until it's
+ready. Use `cryptorand_is_ready()` to check without blocking, or `cryptorand_wait_ready()` to wait
+with a timeout. On POSIX platforms `cryptorand_open_ready_fd()` gives you a descriptor for your
+event loop which becomes readable when the generator is ready. If readiness can't be determined,
+such as when /dev/random can't be opened, `cryptorand_wait_ready()` returns an error rather than
+timing out.
+
+After a sensitive event, such as rotating keys or resuming a virtual machine, you can throw away
+anything that's been buffered and pass additional input to the backend with `cryptorand_reseed()`.
+Individual requests can skip the buffer with `cryptorand_generate_ex()`:
+
+    ```c
+    cryptorand_reseed(&rng, pAdditionalInput, additionalInputSize);
+    cryptorand_generate_ex(&rng, pKey, sizeof(pKey), CRYPTORAND_GENERATE_PREDICTION_RESISTANCE);
+    ```
+
+A personalization string can be set in the config which is passed to the backend at initialization
+time. The stock /dev/urandom backend mixes both into the kernel's pool by writing them to
+/dev/urandom. The other stock backends ignore them because the operating system takes care of
+reseeding itself.
+
+When you need several independent values at once, such as a salt, IV and key, you can fill them
+all with one call to `cryptorand_generate_v()`. Without buffering, the small ones are read from the
+backend together in a single call:
+
+    ```c
+    cryptorand_iovec vecs[3];
+    vecs[0].pData = salt; vecs[0].size = sizeof(salt);
+    vecs[1].pData = iv;   vecs[1].size = sizeof(iv);
+    vecs[2].pData = key;  vecs[2].size = sizeof(key);
+
+    cryptorand_generate_v(&rng, vecs, 3);
+    ```
+
 Thread safety depends on the backend.
 */
 
 #ifndef cryptorand_h
 #define cryptorand_h
 
+/*
+Needed for things like MAP_ANONYMOUS and madvise() when compiling with a strict -std option. This
+needs to come before any system headers are included.
+*/
+#if defined(CRYPTORAND_IMPLEMENTATION) && !defined(_WIN32) && !defined(_DEFAULT_SOURCE)
+    #define _DEFAULT_SOURCE
+#endif
+
+#if defined(CRYPTORAND_INLINE_FASTPATH)
+#include <string.h> /* For memcpy() and memset() in cryptorand_generate_inline(). */
+#endif
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -53,6 +318,28 @@ extern "C" {
     #define CRYPTORAND_URANDOM
 #endif
 
+/*
+By default /dev/urandom is read with stdio. Define CRYPTORAND_NO_STDIO to use open() and read()
+instead so that stdio doesn't need to be linked in. Without stdio's buffering every request is a
+syscall, so consider enabling buffering in the config for lots of small requests.
+
+CRYPTORAND_RAW_SYSCALLS goes a step further and calls getrandom() with inline syscalls rather than
+going through the C library at all, which is useful for static and nolibc executables. This is only
+supported on Linux x86_64 and AArch64 and only applies to the backend. Optional features like the
+secure pool, cryptorand_write_fd() and the readiness functions still use the C library.
+*/
+#if defined(CRYPTORAND_RAW_SYSCALLS)
+    #if !defined(__linux__) || !(defined(__x86_64__) || defined(__aarch64__))
+        #error "CRYPTORAND_RAW_SYSCALLS is only supported on Linux x86_64 and AArch64."
+    #endif
+    #if !defined(CRYPTORAND_NO_STDIO)
+        #define CRYPTORAND_NO_STDIO
+    #endif
+    #if !defined(CRYPTORAND_NO_ARC4RANDOM)
+        #define CRYPTORAND_NO_ARC4RANDOM
+    #endif
+#endif
+
 /*
 OpenBSD recommends using arc4random() over /dev/urandom:
 
@@ -63,26 +350,229 @@ OpenBSD recommends using arc4random() over /dev/urandom:
     #define CRYPTORAND_ARC4RANDOM
 #endif
 
+/*
+glibc 2.36 added arc4random_buf(), and as of glibc 2.41 running on Linux 6.11 or newer it's
+implemented with the vDSO version of getrandom() which is faster than reading from /dev/urandom and
+doesn't need a file descriptor. Before that it makes a syscall for every call, which is slower than
+our buffered reads from /dev/urandom for small requests, so it's only used when both versions are new
+enough. It's referenced weakly so the same build still works with older versions of glibc and with
+musl. Define CRYPTORAND_NO_ARC4RANDOM to always use /dev/urandom.
+*/
+#if defined(__linux__) && !defined(__ANDROID__) && (defined(__GNUC__) || defined(__clang__)) && !defined(CRYPTORAND_NO_ARC4RANDOM)
+    #define CRYPTORAND_ARC4RANDOM_WEAK
+#endif
+
+/* POSIX. Used for things like cryptorand_write_fd() which work with file descriptors. */
+#if !defined(_WIN32) && (defined(__unix__) || defined(__unix) || defined(__APPLE__))
+    #define CRYPTORAND_POSIX
+#endif
+
 #include <stddef.h> /* For size_t. */
 
 #if !defined(CRYPTORAND_API)
     #define CRYPTORAND_API
 #endif
 
+#if defined(_MSC_VER)
+    #define CRYPTORAND_INLINE __forceinline
+#elif defined(__GNUC__)
+    #define CRYPTORAND_INLINE __inline__ __attribute__((always_inline))
+#else
+    #define CRYPTORAND_INLINE
+#endif
+
+typedef unsigned char cryptorand_uint8;
+typedef unsigned int  cryptorand_uint32;
+typedef cryptorand_uint32 cryptorand_bool32;
+#define CRYPTORAND_TRUE     1
+#define CRYPTORAND_FALSE    0
+#if defined(_MSC_VER) && !defined(__clang__)
+    typedef unsigned __int64 cryptorand_uint64;
+#else
+    #if defined(__clang__) || (defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 6)))
+        #pragma GCC diagnostic push
+        #pragma GCC diagnostic ignored "-Wlong-long"
+        #if defined(__clang__)
+            #pragma GCC diagnostic ignored "-Wc++11-long-long"
+        #endif
+    #endif
+    typedef unsigned long long cryptorand_uint64;
+    #if defined(__clang__) || (defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 6)))
+        #pragma GCC diagnostic pop
+    #endif
+#endif
+
+/*
+The size of the intermediary buffer used by cryptorand_generate_stream(). This lives on the stack so
+don't make it too big.
+*/
+#if !defined(CRYPTORAND_STREAM_CHUNK_SIZE)
+    #define CRYPTORAND_STREAM_CHUNK_SIZE    4096
+#endif
+
+/* The size of the stack buffer used by cryptorand_generate_v() to batch up small buffers. */
+#if !defined(CRYPTORAND_GENERATE_V_BLOCK_SIZE)
+    #define CRYPTORAND_GENERATE_V_BLOCK_SIZE    256
+#endif
+
+/*
+The size of the buffer used by cryptorand_write_fd(). This lives on the stack and is aligned to
+CRYPTORAND_WRITE_ALIGNMENT so that it can be used with file descriptors opened with O_DIRECT, which
+means the stack usage is the sum of the two. A page is enough to keep the number of writes down.
+*/
+#if !defined(CRYPTORAND_WRITE_CHUNK_SIZE)
+    #define CRYPTORAND_WRITE_CHUNK_SIZE     4096
+#endif
+#if !defined(CRYPTORAND_WRITE_ALIGNMENT)
+    #define CRYPTORAND_WRITE_ALIGNMENT      4096
+#endif
+
+/*
+Cutoffs for the SP 800-90B health tests. These are derived from a false positive rate of 2^-20 per
+sample with a deliberately pessimistic assumption of 1 bit of entropy per byte. In practice the OS
+output has close to 8 bits per byte so a healthy source will never trip these, whereas a source that
+is stuck on a fixed value will trip the repetition count test within 21 bytes.
+*/
+#if !defined(CRYPTORAND_HEALTH_RCT_CUTOFF)
+    #define CRYPTORAND_HEALTH_RCT_CUTOFF    21
+#endif
+#if !defined(CRYPTORAND_HEALTH_APT_CUTOFF)
+    #define CRYPTORAND_HEALTH_APT_CUTOFF    410     /* Window size is 512. */
+#endif
+
 typedef enum
 {
     CRYPTORAND_SUCCESS           =  0,
     CRYPTORAND_ERROR             = -1,
     CRYPTORAND_INVALID_ARGS      = -2,
     CRYPTORAND_INVALID_OPERATION = -3,
+    CRYPTORAND_OUT_OF_MEMORY     = -4,
+    CRYPTORAND_ACCESS_DENIED     = -6,
     CRYPTORAND_TOO_BIG           = -11,
-    CRYPTORAND_NOT_IMPLEMENTED   = -29
+    CRYPTORAND_IO_ERROR          = -20,
+    CRYPTORAND_NOT_IMPLEMENTED   = -29,
+    CRYPTORAND_TIMEOUT           = -34,
+    CRYPTORAND_HEALTH_FAILURE    = -100     /* The entropy source failed a health test. */
 } cryptorand_result;
 
 typedef void (* cryptorand_proc)(void);
 
 typedef struct
 {
+    void* pUserData;
+    void* (* onMalloc)(size_t sz, void* pUserData);
+    void* (* onRealloc)(void* p, size_t sz, void* pUserData);
+    void  (* onFree)(void* p, void* pUserData);
+} cryptorand_allocation_callbacks;
+
+typedef struct cryptorand cryptorand;
+
+/*
+Backends are implemented with a vtable. The stock backends are implemented with this too, but you
+can also plug in your own, such as a test double or a hardware module. Custom backends are passed
+in via the config and are tried in order before falling back to the stock backends.
+
+Any state required by the backend should be stored in the user data pointer.
+
+onReseed is optional. It's called by cryptorand_reseed() with any additional input from the caller,
+which may be empty, and with the personalization string from the config straight after onInit.
+*/
+typedef struct
+{
+    cryptorand_result (* onInit    )(void* pUserData, cryptorand* pRNG);
+    void              (* onUninit  )(void* pUserData, cryptorand* pRNG);
+    cryptorand_result (* onGenerate)(void* pUserData, cryptorand* pRNG, void* pBufferOut, size_t byteCount);
+    cryptorand_result (* onReseed  )(void* pUserData, cryptorand* pRNG, const void* pAdditionalInput, size_t additionalInputSize);
+} cryptorand_backend_vtable;
+
+/*
+Callback used with cryptorand_generate_stream(). Return anything other than CRYPTORAND_SUCCESS to
+abort the stream, in which case that result code will be returned by cryptorand_generate_stream().
+*/
+typedef cryptorand_result (* cryptorand_stream_proc)(void* pUserData, const void* pData, size_t dataSize);
+
+/*
+Counters retrieved with cryptorand_get_stats(). These are updated atomically so no counts are lost
+when a generator is shared between threads. Each counter is read individually, so a snapshot taken
+while calls are in flight may not be consistent across fields.
+
+The latency histogram is only filled in when enableLatencyHistogram is set in the config. Only calls
+into the backend are timed because a copy out of the buffer is too quick to be worth measuring.
+Bucket i counts calls which took at least 2^i nanoseconds and less than 2^(i+1), with the first and
+last buckets catching everything below and above.
+*/
+#define CRYPTORAND_LATENCY_HISTOGRAM_SIZE   32
+
+typedef struct
+{
+    cryptorand_uint64 generateCount;        /* The number of calls to cryptorand_generate(), successful or not. */
+    cryptorand_uint64 bytesGenerated;       /* The number of bytes successfully returned to the caller. */
+    cryptorand_uint64 backendReadCount;     /* The number of times the backend was called. For the stock backends this roughly equates to syscalls. */
+    cryptorand_uint64 backendBytesRead;
+    cryptorand_uint64 failureCount;         /* The number of calls to cryptorand_generate() that failed, including health test failures. */
+    cryptorand_uint64 healthFailureCount;
+    cryptorand_uint64 bufferHitCount;       /* The number of calls to cryptorand_generate() that were served entirely from the internal buffer. Always 0 when buffering is disabled. */
+    cryptorand_uint64 bufferRefillCount;
+    cryptorand_uint64 reseedCount;          /* The number of calls to cryptorand_reseed(). */
+    cryptorand_uint64 latencyHistogram[CRYPTORAND_LATENCY_HISTOGRAM_SIZE];
+} cryptorand_stats;
+
+/*
+Callback for exporting statistics to a metrics pipeline. It's fired after every call into the
+backend, never on the buffered fast path, so do any rate limiting inside the callback. It can be
+called from any thread that's using the generator.
+*/
+typedef void (* cryptorand_stats_proc)(void* pUserData, const cryptorand* pRNG, const cryptorand_stats* pStats);
+
+typedef struct
+{
+    const cryptorand_backend_vtable* const* ppCustomBackendVTables;   /* Tried in order before the stock backends. */
+    cryptorand_uint32 customBackendCount;
+    void* pCustomBackendUserData;
+    cryptorand_bool32 enableHealthTests;    /* When set, the output of the backend is run through the SP 800-90B repetition count and adaptive proportion tests. */
+    size_t bufferSizeInBytes;               /* When non-zero, small requests are served from an internal buffer of this size which is refilled from the backend. */
+    const void* pPersonalization;           /* Optional. Passed to the backend's onReseed after initialization. Ignored by derived generators. */
+    size_t personalizationSizeInBytes;
+    cryptorand_bool32 enableLatencyHistogram;   /* When set, calls into the backend are timed. See cryptorand_stats. */
+    cryptorand_stats_proc onStats;          /* Optional. Called after every call into the backend. */
+    void* pStatsUserData;
+    cryptorand_allocation_callbacks allocationCallbacks;
+} cryptorand_config;
+
+CRYPTORAND_API cryptorand_config cryptorand_config_init(void);
+
+
+struct cryptorand
+{
+    const cryptorand_backend_vtable* pBackendVTable;  /* The backend that was selected at initialization time. */
+    void* pBackendUserData;
+    cryptorand* pParent;                /* Set for generators created with cryptorand_derive(). The backend belongs to the parent. */
+    struct
+    {
+        cryptorand_bool32 enabled;
+        cryptorand_bool32 failed;           /* Once a health test fails, it stays failed until the generator is reinitialized. */
+        cryptorand_uint8  rctValue;         /* Repetition count test. */
+        cryptorand_uint32 rctCount;
+        cryptorand_uint8  aptValue;         /* Adaptive proportion test. */
+        cryptorand_uint32 aptCount;
+        cryptorand_uint32 aptIndex;
+    } health;
+    cryptorand_stats stats;
+    cryptorand_bool32 enableLatencyHistogram;
+    cryptorand_stats_proc onStats;
+    void* pStatsUserData;
+    struct
+    {
+        cryptorand_uint8* pData;
+        size_t capacity;
+        size_t cursor;                      /* The number of bytes that have been consumed. Consumed bytes are zeroed. */
+        cryptorand_uint32 forkGeneration;   /* Used to detect when we're running in a forked child so the buffered data can be discarded. */
+    } buffer;
+
+    /* Memory management. */
+    cryptorand_allocation_callbacks allocationCallbacks;
+    void* _pHeap;
+    cryptorand_bool32 _ownsHeap;
 #if defined(CRYPTORAND_WIN32)
     struct
     {
@@ -102,291 +592,3929 @@ typedef struct
 #if defined(CRYPTORAND_URANDOM)
     struct
     {
+    #if !defined(CRYPTORAND_NO_STDIO)
         /*FILE**/ void* pFile;  /* The file handle returned by open(). */
+    #elif !defined(CRYPTORAND_RAW_SYSCALLS)
+        int fd;                 /* The file descriptor returned by open(). */
+    #else
+        int __unused;           /* getrandom() doesn't need any state. */
+    #endif
     } urandom;
 #endif
-#if defined(CRYPTORAND_ARC4RANDOM)
+#if defined(CRYPTORAND_ARC4RANDOM) || defined(CRYPTORAND_ARC4RANDOM_WEAK)
     struct
     {
         int __unused;
     } arc4;
 #endif
-} cryptorand;
+};
+
+/*
+A generator can be zero initialized with CRYPTORAND_STATIC_INIT instead of calling cryptorand_init(),
+in which case it'll be initialized with the default config on first use. This is thread safe, but
+you still need to call cryptorand_uninit() if you want to release the backend. Once uninitialized,
+a generator returns CRYPTORAND_INVALID_OPERATION until it's explicitly initialized again.
+cryptorand_default() returns a process wide generator set up this way. Don't uninitialize it.
+*/
+#if defined(__cplusplus)
+    #define CRYPTORAND_STATIC_INIT  {}
+#else
+    #define CRYPTORAND_STATIC_INIT  {0}
+#endif
 
+CRYPTORAND_API cryptorand* cryptorand_default(void);
 CRYPTORAND_API cryptorand_result cryptorand_init(cryptorand* pRNG);
+CRYPTORAND_API cryptorand_result cryptorand_init_ex(const cryptorand_config* pConfig, cryptorand* pRNG);
+CRYPTORAND_API cryptorand_result cryptorand_get_heap_size(const cryptorand_config* pConfig, size_t* pHeapSizeInBytes);
+CRYPTORAND_API cryptorand_result cryptorand_init_preallocated(const cryptorand_config* pConfig, void* pHeap, cryptorand* pRNG);
 CRYPTORAND_API void cryptorand_uninit(cryptorand* pRNG);
+
+/*
+Derived generators share the backend of the parent, so they're cheap to create and don't open any
+new handles, but have their own buffer, health tests and statistics as specified in the config. The
+backend settings in the config are ignored. The parent must outlive all of its children and the
+backend must be thread safe if parent and children are used from different threads, which is the
+case for all of the stock backends. Deriving from a parent that has been uninitialized returns
+CRYPTORAND_INVALID_OPERATION.
+*/
+CRYPTORAND_API cryptorand_result cryptorand_derive(cryptorand* pParent, const cryptorand_config* pConfig, cryptorand* pChild);
+CRYPTORAND_API cryptorand_result cryptorand_derive_preallocated(cryptorand* pParent, const cryptorand_config* pConfig, void* pHeap, cryptorand* pChild);
 CRYPTORAND_API cryptorand_result cryptorand_generate(cryptorand* pRNG, void* pBufferOut, size_t byteCount);
 
-#ifdef __cplusplus
-}
-#endif
-#endif  /* cryptorand_h */
+/*
+Flags for cryptorand_generate_ex(). With CRYPTORAND_GENERATE_PREDICTION_RESISTANCE the request skips
+the internal buffer and is read straight from the backend, so none of it was generated before the
+call was made. This relies on the backend not buffering anything itself, which is true of all of the
+stock backends. Custom backends that buffer should drop their buffer in onGenerate.
+*/
+#define CRYPTORAND_GENERATE_PREDICTION_RESISTANCE   0x00000001
 
-#if defined(CRYPTORAND_IMPLEMENTATION)
-#ifndef cryptorand_c
-#define cryptorand_c
+CRYPTORAND_API cryptorand_result cryptorand_generate_ex(cryptorand* pRNG, void* pBufferOut, size_t byteCount, cryptorand_uint32 flags);
 
-#include <string.h>
-#define CRYPTORAND_ZERO_MEMORY(p, sz)      memset((p), 0, (sz))
-#define CRYPTORAND_ZERO_OBJECT(o)          CRYPTORAND_ZERO_MEMORY((o), sizeof(*o))
+/*
+Fills a number of separate buffers in one go, such as a salt, IV and key. Buffers smaller than
+CRYPTORAND_GENERATE_V_BLOCK_SIZE are generated together with a single call into the backend and
+then scattered into place. On failure every buffer is cleared to zero.
+*/
+typedef struct
+{
+    void* pData;
+    size_t size;
+} cryptorand_iovec;
 
-#if defined(CRYPTORAND_WIN32)
-#include <windows.h>    /* For LoadLibrary(). */
+CRYPTORAND_API cryptorand_result cryptorand_generate_v(cryptorand* pRNG, const cryptorand_iovec* pVecs, size_t count);
 
-typedef LONG (WINAPI * CRYPTORAND_PFN_BCryptOpenAlgorithmProvider)(void** phAlgorithm, LPCWSTR pszAlgId, LPCWSTR pszImplementation, ULONG dwFlags);
-typedef LONG (WINAPI * CRYPTORAND_PFN_BCryptCloseAlgorithmProvider)(void* hAlgorithm, ULONG dwFlags);
-typedef LONG (WINAPI * CRYPTORAND_PFN_BCryptGenRandom)(void* hAlgorithm, unsigned char* pbBuffer, ULONG cbBuffer, ULONG dwFlags);
+/*
+Discards any buffered data and passes the additional input, which can be NULL, to the backend. Use
+this after events like key rotation or resuming a virtual machine. The operating system reseeds its
+own generator, so for the stock backends the additional input is only mixed in by /dev/urandom, and
+only when CRYPTORAND_RAW_SYSCALLS is not defined. For derived generators only the generator you
+pass in has its buffer discarded.
+*/
+CRYPTORAND_API cryptorand_result cryptorand_reseed(cryptorand* pRNG, const void* pAdditionalInput, size_t additionalInputSize);
+CRYPTORAND_API cryptorand_result cryptorand_generate_stream(cryptorand* pRNG, cryptorand_uint64 byteCount, cryptorand_stream_proc onData, void* pUserData);
 
-#define CRYPTORAND_BCRYPT_RNG_ALGORITHM L"RNG"
+/*
+Helper for filling an object, such as a fixed size key or nonce array, where the size is known at
+compile time. Use this with a buffered generator for best results.
+*/
+#if defined(CRYPTORAND_INLINE_FASTPATH)
+    #define CRYPTORAND_GENERATE_OBJECT(pRNG, pObject)   cryptorand_generate_inline((pRNG), (pObject), sizeof(*(pObject)))
+#else
+    #define CRYPTORAND_GENERATE_OBJECT(pRNG, pObject)   cryptorand_generate((pRNG), (pObject), sizeof(*(pObject)))
+#endif
 
+CRYPTORAND_API cryptorand_result cryptorand_get_stats(const cryptorand* pRNG, cryptorand_stats* pStats);
 
-typedef BOOL (WINAPI * CRYPTORAND_PFN_CryptAcquireContextW)(void** phProv, LPCWSTR szContainer, LPCWSTR szProvider, DWORD dwProvType, DWORD dwFlags);
-typedef BOOL (WINAPI * CRYPTORAND_PFN_CryptReleaseContext)(void* hProv, DWORD dwFlags);
-typedef BOOL (WINAPI * CRYPTORAND_PFN_CryptGenRandom)(void* hProv, DWORD dwLen, BYTE* pbBuffer);
+/*
+Distributions. These fill an array with samples from the standard normal distribution (mean 0,
+standard deviation 1) and the exponential distribution (rate 1). Scale and offset the results as
+required. Both use a 256 layer Ziggurat and draw their uniform inputs from cryptorand_generate() in
+blocks, so prefer generating many samples at once over calling these in a loop.
+*/
+CRYPTORAND_API cryptorand_result cryptorand_normal_f64_array(cryptorand* pRNG, double* pOut, size_t count);
+CRYPTORAND_API cryptorand_result cryptorand_exponential_f64_array(cryptorand* pRNG, double* pOut, size_t count);
 
-#define CRYPTORAND_PROV_RSA_FULL        1
-#define CRYPTORAND_CRYPT_VERIFYCONTEXT  0xF0000000
-#define CRYPTORAND_CRYPT_SILENT         0x00000040
+/*
+Alias tables for sampling from a discrete distribution in constant time. Build the table once from
+an array of non-negative weights and then draw indices with cryptorand_alias_sample_batch(). Each
+entry holds the threshold and the alias for a column side by side so a draw touches one cache line.
 
-static cryptorand_result cryptorand_init__win32(cryptorand* pRNG)
+Thresholds have 32 bits of precision. The table can either allocate its own memory or you can pass
+in a heap of the size returned by cryptorand_alias_table_get_heap_size(), aligned to at least 8
+bytes. The heap includes some scratch space which is only used while the table is being built.
+*/
+#define CRYPTORAND_ALIAS_TABLE_MAX_COUNT    0x7FFFFFFF
+
+typedef struct
 {
-    /*
-    We first need to try using BCrypt which is the most modern version. If this fails it might mean
-    we're running on Windows XP in which case we'll fall back to CryptGenRandom().
-    */
-    CRYPTORAND_ZERO_OBJECT(&pRNG->win32);   /* For safety. */
-    {
-        HMODULE hBcryptDLL;
+    cryptorand_uint32 threshold;    /* The column itself is selected when a 32-bit uniform is below this, otherwise the alias is. */
+    cryptorand_uint32 alias;
+} cryptorand_alias_entry;
 
-        hBcryptDLL = LoadLibraryW(L"bcrypt.dll");
-        if (hBcryptDLL != NULL) {
-            pRNG->win32.hBcryptDLL                   = (void*)hBcryptDLL;
-            pRNG->win32.BCryptOpenAlgorithmProvider  = (cryptorand_proc)GetProcAddress(hBcryptDLL, "BCryptOpenAlgorithmProvider");
-            pRNG->win32.BCryptCloseAlgorithmProvider = (cryptorand_proc)GetProcAddress(hBcryptDLL, "BCryptCloseAlgorithmProvider");
-            pRNG->win32.BCryptGenRandom              = (cryptorand_proc)GetProcAddress(hBcryptDLL, "BCryptGenRandom");
+typedef struct
+{
+    cryptorand_alias_entry* pEntries;
+    cryptorand_uint32 count;
 
-            if (pRNG->win32.BCryptOpenAlgorithmProvider != NULL && pRNG->win32.BCryptCloseAlgorithmProvider != NULL && pRNG->win32.BCryptGenRandom != NULL) {
-                if (((CRYPTORAND_PFN_BCryptOpenAlgorithmProvider)pRNG->win32.BCryptOpenAlgorithmProvider)(&pRNG->win32.hAlgorithm, CRYPTORAND_BCRYPT_RNG_ALGORITHM, NULL, 0) == 0) {
-                    return CRYPTORAND_SUCCESS;
-                } else {
-                    /* Failed to open provider. */
-                }
-            } else {
-                /* Failed to retrieve function addresses.*/
-            }
-        } else {
-            /* Failed to load DLL. */
-        }
-    }
+    /* Memory management. */
+    cryptorand_allocation_callbacks allocationCallbacks;
+    void* _pHeap;
+    cryptorand_bool32 _ownsHeap;
+} cryptorand_alias_table;
 
+CRYPTORAND_API cryptorand_result cryptorand_alias_table_get_heap_size(cryptorand_uint32 count, size_t* pHeapSizeInBytes);
+CRYPTORAND_API cryptorand_result cryptorand_alias_table_build_preallocated(const double* pWeights, cryptorand_uint32 count, void* pHeap, cryptorand_alias_table* pTable);
+CRYPTORAND_API cryptorand_result cryptorand_alias_table_build(const double* pWeights, cryptorand_uint32 count, const cryptorand_allocation_callbacks* pAllocationCallbacks, cryptorand_alias_table* pTable);
+CRYPTORAND_API void cryptorand_alias_table_uninit(cryptorand_alias_table* pTable);
+CRYPTORAND_API cryptorand_result cryptorand_alias_sample_batch(cryptorand* pRNG, const cryptorand_alias_table* pTable, cryptorand_uint32* pIndices, size_t count);
 
-    /* Getting here means we're falling back to the old method. */
-    CRYPTORAND_ZERO_OBJECT(&pRNG->win32);   /* For safety. */
-    {
-        HMODULE hAdvapiDLL;
+/*
+Keyed permutations. These map [0, count) onto itself in a random order without storing the order
+anywhere, which makes them suitable for visiting a huge range of indices exactly once each. This is
+a balanced Feistel network over the smallest even number of bits that covers the range, with cycle
+walking to bring the result back into range. The key is generated from the RNG at init time.
 
-        hAdvapiDLL = LoadLibraryW(L"advapi32.dll");
-        if (hAdvapiDLL != NULL) {
-            pRNG->win32.hAdvapiDLL           = (void*)hAdvapiDLL;
-            pRNG->win32.CryptAcquireContextW = (cryptorand_proc)GetProcAddress(hAdvapiDLL, "CryptAcquireContextW");
-            pRNG->win32.CryptReleaseContext  = (cryptorand_proc)GetProcAddress(hAdvapiDLL, "CryptReleaseContext");
-            pRNG->win32.CryptGenRandom       = (cryptorand_proc)GetProcAddress(hAdvapiDLL, "CryptGenRandom");
+The round function is a simple keyed mixer. It is not a vetted block cipher and is not suitable for
+format preserving encryption. Use it for randomized ordering only.
+*/
+#if !defined(CRYPTORAND_PERMUTATION_ROUNDS)
+    #define CRYPTORAND_PERMUTATION_ROUNDS   8
+#endif
 
-            if (pRNG->win32.CryptAcquireContextW != NULL && pRNG->win32.CryptReleaseContext != NULL && pRNG->win32.CryptGenRandom != NULL) {
-                if (((CRYPTORAND_PFN_CryptAcquireContextW)pRNG->win32.CryptAcquireContextW)(&pRNG->win32.hProvider, NULL, NULL, CRYPTORAND_PROV_RSA_FULL, CRYPTORAND_CRYPT_VERIFYCONTEXT | CRYPTORAND_CRYPT_SILENT)) {
-                    return CRYPTORAND_SUCCESS;
-                } else {
-                    /* Failed to acquire context. */
-                }
-            } else {
-                /* Failed to retrieve function addresses.*/
-            }
-        } else {
-            /* Failed to load DLL. */
-        }
-    }
+typedef struct
+{
+    cryptorand_uint64 count;
+    cryptorand_uint32 halfBits;
+    cryptorand_uint64 halfMask;
+    cryptorand_uint64 keys[CRYPTORAND_PERMUTATION_ROUNDS];
+} cryptorand_permutation;
 
+CRYPTORAND_API cryptorand_result cryptorand_permutation_init(cryptorand* pRNG, cryptorand_uint64 count, cryptorand_permutation* pPermutation);
+CRYPTORAND_API void cryptorand_permutation_uninit(cryptorand_permutation* pPermutation);
+CRYPTORAND_API cryptorand_uint64 cryptorand_permutation_permute(const cryptorand_permutation* pPermutation, cryptorand_uint64 index);   /* Indices >= count are returned as is. */
+CRYPTORAND_API cryptorand_uint64 cryptorand_permutation_inverse(const cryptorand_permutation* pPermutation, cryptorand_uint64 index);
+CRYPTORAND_API void cryptorand_permutation_permute_batch(const cryptorand_permutation* pPermutation, const cryptorand_uint64* pIndicesIn, cryptorand_uint64* pIndicesOut, size_t count);  /* pIndicesIn and pIndicesOut can be the same. */
 
-    /* Getting here means both BCryptGenRandom() and CryptGenRandom() are unusable. */
+/*
+Uniform integers below an arbitrary bound, such as secret scalars for elliptic curve or RSA blinding
+factors. Integers are big-endian byte arrays of len bytes and the bound must not be zero. The output
+is in [0, bound). This uses rejection sampling with a constant time comparison so the time taken
+depends only on the number of rejections, which reveals nothing about the value that's returned.
+
+The group order helpers output a 32-byte scalar in [1, n) where n is the order of the named group.
+These are the scalars you'd use for private keys and ephemeral nonces.
+*/
+CRYPTORAND_API cryptorand_result cryptorand_bigint_below(cryptorand* pRNG, const cryptorand_uint8* pBound, size_t len, cryptorand_uint8* pOut);
+CRYPTORAND_API cryptorand_result cryptorand_scalar_p256(cryptorand* pRNG, cryptorand_uint8* pOut);
+CRYPTORAND_API cryptorand_result cryptorand_scalar_secp256k1(cryptorand* pRNG, cryptorand_uint8* pOut);
+CRYPTORAND_API cryptorand_result cryptorand_scalar_curve25519(cryptorand* pRNG, cryptorand_uint8* pOut);     /* The order of the prime order subgroup, as used by Ed25519. */
+
+/*
+Random strings. cryptorand_string() fills pOut with count symbols chosen uniformly from an alphabet
+of up to 256 characters, such as digits or an unambiguous set for codes that people need to read
+back. The output is not null terminated.
+
+cryptorand_passphrase() picks wordCount words from a caller supplied list and joins them with the
+separator. The output is null terminated and CRYPTORAND_TOO_BIG is returned if outCap is not big
+enough. The strength of the passphrase in bits is returned in pEntropyBits, which can be NULL. Make
+sure the word list doesn't contain duplicates or the real strength will be lower than reported.
+*/
+CRYPTORAND_API cryptorand_result cryptorand_string(cryptorand* pRNG, const char* pAlphabet, size_t alphabetLen, char* pOut, size_t count);
+CRYPTORAND_API cryptorand_result cryptorand_passphrase(cryptorand* pRNG, const char* const* ppWordList, size_t wordListCount, size_t wordCount, const char* pSeparator, char* pOut, size_t outCap, double* pEntropyBits);
+
+/*
+Nonce generator for AEAD ciphers. Each nonce is a random prefix drawn from the RNG followed by a
+big-endian counter, so nonces are guaranteed unique for the lifetime of a prefix and generating one
+doesn't touch the backend. 12-byte nonces, for AES-GCM and ChaCha20-Poly1305, are an 8-byte prefix
+and a 4-byte counter. 24-byte nonces, for XChaCha20-Poly1305, are a 16-byte prefix and an 8-byte
+counter. A new prefix is drawn when the counter runs out and in the child process after fork().
+
+Use one generator per thread. There's no locking so a generator must not be shared between threads
+without external synchronization. The RNG needs to remain valid for the life of the generator.
+*/
+typedef struct
+{
+    cryptorand* pRNG;
+    cryptorand_uint32 nonceSize;
+    cryptorand_uint32 prefixSize;
+    cryptorand_uint8 prefix[16];
+    cryptorand_uint64 counter;              /* The counter of the next nonce. */
+    cryptorand_uint64 counterLimit;         /* A new prefix is drawn when the counter reaches this. */
+    cryptorand_uint32 forkGeneration;
+} cryptorand_nonce_generator;
+
+CRYPTORAND_API cryptorand_result cryptorand_nonce_generator_init(cryptorand* pRNG, size_t nonceSize, cryptorand_nonce_generator* pGenerator);    /* nonceSize must be 12 or 24. */
+CRYPTORAND_API void cryptorand_nonce_generator_uninit(cryptorand_nonce_generator* pGenerator);
+CRYPTORAND_API cryptorand_result cryptorand_nonce_generator_next(cryptorand_nonce_generator* pGenerator, void* pNonceOut);
+
+/*
+Entropy readiness. Early in boot, and in freshly started virtual machines, the operating system may
+not have gathered enough entropy to seed its generator. The /dev/urandom backend doesn't check for
+this and the arc4random() backend blocks until it's ready, so use these if you need to know.
+cryptorand_is_ready() never blocks. cryptorand_wait_ready() blocks for up to the specified number of
+milliseconds and returns CRYPTORAND_TIMEOUT if the generator is still not ready. Use
+CRYPTORAND_TIMEOUT_INFINITE to wait forever.
+
+If readiness can't be determined, such as when /dev/random can't be opened in a sandbox,
+cryptorand_wait_ready() returns the error rather than CRYPTORAND_TIMEOUT. cryptorand_is_ready()
+returns false in this case, so use cryptorand_wait_ready(0) if you need to tell the two apart.
+
+On POSIX platforms cryptorand_open_ready_fd() returns a non-blocking descriptor which becomes readable
+when the generator is ready. Add it to your poll()/epoll loop to carry on with other initialization in
+the meantime. Close it with close() when you're done. Don't read from it.
+
+On Windows the generator is always ready.
+*/
+#define CRYPTORAND_TIMEOUT_INFINITE 0xFFFFFFFF
+
+CRYPTORAND_API cryptorand_bool32 cryptorand_is_ready(void);
+CRYPTORAND_API cryptorand_result cryptorand_wait_ready(cryptorand_uint32 timeoutInMilliseconds);
+#if defined(CRYPTORAND_POSIX)
+CRYPTORAND_API cryptorand_result cryptorand_open_ready_fd(int* pFD);
+#endif
+
+#if defined(CRYPTORAND_POSIX)
+CRYPTORAND_API cryptorand_result cryptorand_write_fd(cryptorand* pRNG, int fd, cryptorand_uint64 byteCount);
+#endif
+
+
+/*
+Secure memory pool. This maps a single block of locked memory, surrounded by guard pages, and splits
+it into fixed size slots. The idea is that you size a slot with cryptorand_get_heap_size() and then
+place many generators in the pool via cryptorand_secure_pool_get_allocation_callbacks(). This way the
+cost of mmap() and mlock() is paid once rather than per generator and the amount of locked memory is
+kept to a minimum.
+
+Slot memory is excluded from core dumps and wiped in forked children where supported. Slots are
+aligned to CRYPTORAND_SECURE_POOL_ALIGNMENT and zeroed when freed.
+
+The pool is not thread safe.
+*/
+#if defined(CRYPTORAND_POSIX)
+#if !defined(CRYPTORAND_SECURE_POOL_ALIGNMENT)
+    #define CRYPTORAND_SECURE_POOL_ALIGNMENT    64
+#endif
+
+typedef struct
+{
+    void* pMapping;                 /* The whole mapping, including guard pages. */
+    size_t mappingSizeInBytes;
+    cryptorand_uint32* pNextFree;   /* The free list. One entry per slot. */
+    cryptorand_uint8* pSlots;
+    size_t slotSizeInBytes;
+    cryptorand_uint32 slotCount;
+    cryptorand_uint32 freeHead;     /* Set to slotCount when there are no free slots. */
+} cryptorand_secure_pool;
+
+CRYPTORAND_API cryptorand_result cryptorand_secure_pool_init(size_t slotSizeInBytes, cryptorand_uint32 slotCount, cryptorand_secure_pool* pPool);
+CRYPTORAND_API void cryptorand_secure_pool_uninit(cryptorand_secure_pool* pPool);
+CRYPTORAND_API void* cryptorand_secure_pool_alloc(cryptorand_secure_pool* pPool, size_t sizeInBytes);
+CRYPTORAND_API void cryptorand_secure_pool_free(cryptorand_secure_pool* pPool, void* p);
+CRYPTORAND_API cryptorand_allocation_callbacks cryptorand_secure_pool_get_allocation_callbacks(cryptorand_secure_pool* pPool);
+#endif
+
+/*
+Statistics are updated with relaxed atomic adds. The counters are never used for synchronization so
+nothing stronger is needed.
+
+CRYPTORAND_STATS_ADD_UNSHARED() is a relaxed load and store rather than a locked add. It's only used
+on paths that only buffered generators take, such as the inline fast path. A buffered generator
+can't be shared between threads so there's only ever one writer, and a locked add there would cost
+several times more than the rest of the request.
+*/
+#if defined(__clang__) || (defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 7)))
+    #define CRYPTORAND_STATS_ADD(pRNG, field, n)            (void)__atomic_fetch_add(&(pRNG)->stats.field, (cryptorand_uint64)(n), __ATOMIC_RELAXED)
+    #define CRYPTORAND_STATS_ADD_UNSHARED(pRNG, field, n)   __atomic_store_n(&(pRNG)->stats.field, __atomic_load_n(&(pRNG)->stats.field, __ATOMIC_RELAXED) + (cryptorand_uint64)(n), __ATOMIC_RELAXED)
+    #define CRYPTORAND_STATS_LOAD(pCounter)                 __atomic_load_n((pCounter), __ATOMIC_RELAXED)
+#elif defined(_MSC_VER)
+    /* The interlocked intrinsics are declared in <intrin.h> which is included by the implementation. */
+    #define CRYPTORAND_STATS_ADD(pRNG, field, n)            (void)_InterlockedExchangeAdd64((volatile __int64*)&(pRNG)->stats.field, (__int64)(n))
+    #define CRYPTORAND_STATS_ADD_UNSHARED(pRNG, field, n)   (void)(*(volatile cryptorand_uint64*)&(pRNG)->stats.field = *(volatile cryptorand_uint64*)&(pRNG)->stats.field + (cryptorand_uint64)(n))
+    #define CRYPTORAND_STATS_LOAD(pCounter)                 (cryptorand_uint64)_InterlockedCompareExchange64((volatile __int64*)(pCounter), 0, 0)
+#else
+    /* No atomics available. Counts may be lost if a generator is shared between threads. */
+    #define CRYPTORAND_STATS_ADD(pRNG, field, n)            (void)(*(volatile cryptorand_uint64*)&(pRNG)->stats.field = *(volatile cryptorand_uint64*)&(pRNG)->stats.field + (cryptorand_uint64)(n))
+    #define CRYPTORAND_STATS_ADD_UNSHARED(pRNG, field, n)   CRYPTORAND_STATS_ADD(pRNG, field, n)
+    #define CRYPTORAND_STATS_LOAD(pCounter)                 (*(const volatile cryptorand_uint64*)(pCounter))
+#endif
+
+#if defined(CRYPTORAND_POSIX)
+/*
+Incremented in the child process after fork(). This is used to detect when buffered data has been
+duplicated into a child process. Don't modify this.
+*/
+extern volatile cryptorand_uint32 cryptorand_g_fork_generation;
+#endif
+
+/*
+Inline fast path. When CRYPTORAND_INLINE_FASTPATH is defined, cryptorand_generate_inline() is
+available as a static inline function which copies straight out of the buffer of a buffered
+generator, only calling into cryptorand_generate() when the buffer needs to be refilled. This
+removes the function call overhead for small requests without needing link time optimization.
+Anything else, including unbuffered, uninitialized and lazily initialized generators, goes through
+cryptorand_generate() so the result is always the same as calling it directly.
+*/
+#if defined(CRYPTORAND_INLINE_FASTPATH)
+static CRYPTORAND_INLINE cryptorand_result cryptorand_generate_inline(cryptorand* pRNG, void* pBufferOut, size_t byteCount)
+{
+    if (pRNG != NULL && pBufferOut != NULL && pRNG->buffer.pData != NULL && byteCount <= pRNG->buffer.capacity - pRNG->buffer.cursor && !pRNG->health.failed
+    #if defined(CRYPTORAND_POSIX)
+        && pRNG->buffer.forkGeneration == cryptorand_g_fork_generation
+    #endif
+    ) {
+        memcpy(pBufferOut, pRNG->buffer.pData + pRNG->buffer.cursor, byteCount);
+        memset(pRNG->buffer.pData + pRNG->buffer.cursor, 0, byteCount);
+        pRNG->buffer.cursor += byteCount;
+
+        CRYPTORAND_STATS_ADD_UNSHARED(pRNG, generateCount,  1);
+        CRYPTORAND_STATS_ADD_UNSHARED(pRNG, bytesGenerated, byteCount);
+        CRYPTORAND_STATS_ADD_UNSHARED(pRNG, bufferHitCount, 1);
+
+        return CRYPTORAND_SUCCESS;
+    }
+
+    return cryptorand_generate(pRNG, pBufferOut, byteCount);
+}
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+/*
+C++ wrapper. This is a move-only RAII wrapper around a cryptorand object which satisfies the
+UniformRandomBitGenerator requirements so it can be used with the standard library's distributions
+and algorithms:
+
+    cryptorand_cpp::engine rng;
+    std::uniform_int_distribution<int> dist(1, 6);
+    int roll = dist(rng);
+
+Random data is read from the backend in blocks of CRYPTORAND_ENGINE_BUFFER_SIZE bytes so that most
+calls to operator() are just a copy out of the buffer. Like with the buffered mode of the C API,
+bytes are zeroed as they're handed out and the buffer is discarded in a forked child.
+
+The namespace is cryptorand_cpp rather than cryptorand because the latter is already taken by the C
+type. Errors are reported with std::runtime_error, or std::abort() if exceptions are disabled.
+
+Generators derived from get() with cryptorand_derive() point to the engine's cryptorand object, and
+moving the engine moves that object. An engine therefore must not be moved while it has children.
+*/
+#if defined(__cplusplus) && !defined(CRYPTORAND_NO_CPP) && (__cplusplus >= 201103L || (defined(_MSVC_LANG) && _MSVC_LANG >= 201103L))
+#include <cstring>
+#include <cstdlib>
+#include <stdexcept>
+#include <type_traits>
+
+#if !defined(CRYPTORAND_ENGINE_BUFFER_SIZE)
+    #define CRYPTORAND_ENGINE_BUFFER_SIZE   256
+#endif
+
+namespace cryptorand_cpp
+{
+    namespace detail
+    {
+        inline void fail(cryptorand_result result)
+        {
+        #if defined(__cpp_exceptions) || defined(__EXCEPTIONS) || defined(_CPPUNWIND)
+            throw std::runtime_error((result == CRYPTORAND_HEALTH_FAILURE) ? "cryptorand: entropy source failed a health test" : "cryptorand: failed to generate random data");
+        #else
+            (void)result;
+            std::abort();
+        #endif
+        }
+
+        inline cryptorand_uint32 fork_generation()
+        {
+        #if defined(CRYPTORAND_POSIX)
+            return cryptorand_g_fork_generation;
+        #else
+            return 0;
+        #endif
+        }
+    }
+
+    class engine
+    {
+    public:
+        typedef cryptorand_uint64 result_type;
+
+        static constexpr result_type min() { return 0; }
+        static constexpr result_type max() { return ~result_type(0); }
+
+        engine()
+        {
+            cryptorand_result result = cryptorand_init(&m_rng);
+            if (result != CRYPTORAND_SUCCESS) {
+                detail::fail(result);
+            }
+
+            reset_buffer();
+        }
+
+        explicit engine(const cryptorand_config& config)
+        {
+            cryptorand_result result = cryptorand_init_ex(&config, &m_rng);
+            if (result != CRYPTORAND_SUCCESS) {
+                detail::fail(result);
+            }
+
+            reset_buffer();
+        }
+
+        ~engine()
+        {
+            release();
+        }
+
+        engine(engine&& other) noexcept
+        {
+            take(other);
+        }
+
+        engine& operator=(engine&& other) noexcept
+        {
+            if (this != &other) {
+                release();
+                take(other);
+            }
+
+            return *this;
+        }
+
+        engine(const engine&) = delete;
+        engine& operator=(const engine&) = delete;
+
+        result_type operator()()
+        {
+            return generate<result_type>();
+        }
+
+        /* Bulk generation. This goes straight to the C API and does not touch the internal buffer. */
+        void generate(void* pBufferOut, size_t byteCount)
+        {
+            cryptorand_result result = cryptorand_generate(&m_rng, pBufferOut, byteCount);
+            if (result != CRYPTORAND_SUCCESS) {
+                detail::fail(result);
+            }
+        }
+
+        /*
+        Fixed size generation. The size is known at compile time so the copy out of the buffer can be
+        fully unrolled. Sizes bigger than the buffer go through the bulk path.
+        */
+        template <size_t N>
+        void generate(void* pBufferOut)
+        {
+            if (N > sizeof(m_buffer)) {
+                generate(pBufferOut, N);
+                return;
+            }
+
+            if (m_cursor + N > sizeof(m_buffer) || m_forkGeneration != detail::fork_generation()) {
+                refill();
+            }
+
+            std::memcpy(pBufferOut, m_buffer + m_cursor, N);
+            std::memset(m_buffer + m_cursor, 0, N);
+            m_cursor += N;
+        }
+
+        template <size_t N>
+        void generate(unsigned char (&pBufferOut)[N])
+        {
+            generate<N>(static_cast<void*>(pBufferOut));
+        }
+
+        template <typename T>
+        T generate()
+        {
+            static_assert(std::is_trivially_copyable<T>::value, "cryptorand_cpp::engine::generate<T>() requires a trivially copyable type.");
+
+            T value;
+            generate<sizeof(T)>(static_cast<void*>(&value));
+            return value;
+        }
+
+        /* Discards the engine's own buffer as well as the generator's. */
+        void reseed(const void* pAdditionalInput = nullptr, size_t additionalInputSize = 0)
+        {
+            cryptorand_result result = cryptorand_reseed(&m_rng, pAdditionalInput, additionalInputSize);
+            if (result != CRYPTORAND_SUCCESS) {
+                detail::fail(result);
+            }
+
+            reset_buffer();
+        }
+
+        /* Don't move the engine while generators derived from this are alive. */
+        cryptorand* get() { return &m_rng; }
+        const cryptorand* get() const { return &m_rng; }
+
+    private:
+        cryptorand m_rng;
+        size_t m_cursor;
+        cryptorand_uint32 m_forkGeneration;
+        bool m_initialized;
+        unsigned char m_buffer[CRYPTORAND_ENGINE_BUFFER_SIZE];
+
+        void reset_buffer()
+        {
+            std::memset(m_buffer, 0, sizeof(m_buffer));
+            m_cursor         = sizeof(m_buffer);
+            m_forkGeneration = detail::fork_generation();
+            m_initialized    = true;
+        }
+
+        void refill()
+        {
+            cryptorand_result result;
+
+            m_forkGeneration = detail::fork_generation();
+
+            result = cryptorand_generate(&m_rng, m_buffer, sizeof(m_buffer));
+            if (result != CRYPTORAND_SUCCESS) {
+                m_cursor = sizeof(m_buffer);
+                detail::fail(result);
+            }
+
+            m_cursor = 0;
+        }
+
+        void release()
+        {
+            if (m_initialized) {
+                cryptorand_uninit(&m_rng);
+                std::memset(m_buffer, 0, sizeof(m_buffer));
+                m_initialized = false;
+            }
+        }
+
+        void take(engine& other)
+        {
+            /*
+            The cryptorand object holds no pointers into itself so a plain copy is enough, but derived
+            children point to it and are left dangling. See the restriction on get().
+            */
+            m_rng            = other.m_rng;
+            m_cursor         = other.m_cursor;
+            m_forkGeneration = other.m_forkGeneration;
+            m_initialized    = other.m_initialized;
+            std::memcpy(m_buffer, other.m_buffer, sizeof(m_buffer));
+
+            std::memset(&other.m_rng, 0, sizeof(other.m_rng));
+            std::memset(other.m_buffer, 0, sizeof(other.m_buffer));
+            other.m_cursor      = sizeof(other.m_buffer);
+            other.m_initialized = false;
+        }
+    };
+}
+#endif
+#endif  /* cryptorand_h */
+
+#if defined(CRYPTORAND_IMPLEMENTATION)
+#ifndef cryptorand_c
+#define cryptorand_c
+
+#include <string.h>
+#define CRYPTORAND_ZERO_MEMORY(p, sz)      memset((p), 0, (sz))
+#define CRYPTORAND_ZERO_OBJECT(o)          CRYPTORAND_ZERO_MEMORY((o), sizeof(*o))
+#define CRYPTORAND_COPY_MEMORY(dst, src, sz) memcpy((dst), (src), (sz))
+
+/*
+USDT probes for tracing with tools like bpftrace. These are opt-in with CRYPTORAND_ENABLE_USDT and
+require <sys/sdt.h>. When enabled each probe is a single nop until a tracer attaches. When disabled
+they compile to nothing.
+*/
+#if defined(CRYPTORAND_ENABLE_USDT)
+    #include <sys/sdt.h>
+    #define CRYPTORAND_PROBE1(name, a)      DTRACE_PROBE1(cryptorand, name, a)
+    #define CRYPTORAND_PROBE2(name, a, b)   DTRACE_PROBE2(cryptorand, name, a, b)
+#else
+    #define CRYPTORAND_PROBE1(name, a)
+    #define CRYPTORAND_PROBE2(name, a, b)
+#endif
+
+#include <stdlib.h> /* For malloc(), realloc() and free(). */
+
+static void* cryptorand__malloc_default(size_t sz, void* pUserData)
+{
+    (void)pUserData;
+    return malloc(sz);
+}
+
+static void* cryptorand__realloc_default(void* p, size_t sz, void* pUserData)
+{
+    (void)pUserData;
+    return realloc(p, sz);
+}
+
+static void cryptorand__free_default(void* p, void* pUserData)
+{
+    (void)pUserData;
+    free(p);
+}
+
+static cryptorand_result cryptorand_allocation_callbacks_init_copy(cryptorand_allocation_callbacks* pDst, const cryptorand_allocation_callbacks* pSrc)
+{
+    if (pSrc == NULL || (pSrc->pUserData == NULL && pSrc->onMalloc == NULL && pSrc->onRealloc == NULL && pSrc->onFree == NULL)) {
+        pDst->pUserData = NULL;
+        pDst->onMalloc  = cryptorand__malloc_default;
+        pDst->onRealloc = cryptorand__realloc_default;
+        pDst->onFree    = cryptorand__free_default;
+    } else {
+        if (pSrc->onMalloc == NULL || pSrc->onFree == NULL) {
+            return CRYPTORAND_INVALID_ARGS; /* Need at least malloc and free. Realloc is optional. */
+        }
+
+        *pDst = *pSrc;
+    }
+
+    return CRYPTORAND_SUCCESS;
+}
+
+static void* cryptorand_malloc(size_t sz, const cryptorand_allocation_callbacks* pAllocationCallbacks)
+{
+    return pAllocationCallbacks->onMalloc(sz, pAllocationCallbacks->pUserData);
+}
+
+static void cryptorand_free(void* p, const cryptorand_allocation_callbacks* pAllocationCallbacks)
+{
+    if (p == NULL) {
+        return;
+    }
+
+    pAllocationCallbacks->onFree(p, pAllocationCallbacks->pUserData);
+}
+
+
+/*
+Atomics for lazy initialization. A generator is published by storing its backend vtable last with
+release semantics so that any thread which sees it set also sees the rest of the initialized state.
+Until then other threads may be reading the vtable, so it must only ever be written with an atomic
+store. Initialization is serialized with a global lock, which is fine because it only ever happens
+once per generator.
+*/
+#if defined(CRYPTORAND_WIN32)
+#include <windows.h>
+#elif defined(CRYPTORAND_POSIX)
+#include <sched.h>
+#endif
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+
+static volatile long cryptorand_g_lazy_init_lock = 0;
+
+static void cryptorand_yield(void)
+{
+#if defined(CRYPTORAND_WIN32)
+    SwitchToThread();
+#elif defined(CRYPTORAND_POSIX)
+    sched_yield();
+#endif
+}
+
+/* The lock is held while a backend is opened which can take a while, so waiters yield rather than spin. */
+static void cryptorand_lazy_init_lock(void)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    while (!__sync_bool_compare_and_swap(&cryptorand_g_lazy_init_lock, 0, 1)) {
+        cryptorand_yield();
+    }
+#elif defined(_MSC_VER)
+    while (_InterlockedCompareExchange(&cryptorand_g_lazy_init_lock, 1, 0) != 0) {
+        cryptorand_yield();
+    }
+#else
+    cryptorand_g_lazy_init_lock = 1;    /* No atomics on this compiler. Lazy initialization will not be thread safe. */
+#endif
+}
+
+static void cryptorand_lazy_init_unlock(void)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    __sync_lock_release(&cryptorand_g_lazy_init_lock);
+#elif defined(_MSC_VER)
+    _InterlockedExchange(&cryptorand_g_lazy_init_lock, 0);
+#else
+    cryptorand_g_lazy_init_lock = 0;
+#endif
+}
+
+static const cryptorand_backend_vtable* cryptorand_load_backend_vtable(const cryptorand* pRNG)
+{
+#if defined(__clang__) || (defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 7)))
+    return __atomic_load_n(&pRNG->pBackendVTable, __ATOMIC_ACQUIRE);
+#else
+    /* MSVC gives volatile accesses acquire and release semantics by default. */
+    return *(const cryptorand_backend_vtable* const volatile*)&pRNG->pBackendVTable;
+#endif
+}
+
+static void cryptorand_store_backend_vtable(cryptorand* pRNG, const cryptorand_backend_vtable* pBackendVTable)
+{
+#if defined(__clang__) || (defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 7)))
+    __atomic_store_n(&pRNG->pBackendVTable, pBackendVTable, __ATOMIC_RELEASE);
+#else
+    *(const cryptorand_backend_vtable* volatile*)&pRNG->pBackendVTable = pBackendVTable;
+#endif
+}
+
+/*
+Clears everything except the vtable, which is cleared with an atomic store instead. This relies on
+the vtable being the first member.
+*/
+static void cryptorand_zero_object(cryptorand* pRNG)
+{
+    cryptorand_store_backend_vtable(pRNG, NULL);
+    CRYPTORAND_ZERO_MEMORY(&pRNG->pBackendUserData, sizeof(*pRNG) - offsetof(cryptorand, pBackendUserData));
+}
+
+
+/*
+Fork detection. When buffering, the buffered data would be duplicated in a forked child which means
+the parent and child would hand out the same bytes. To prevent this, a generation counter is
+incremented in the child via pthread_atfork(). Each generator remembers the generation at the time
+it last filled its buffer and discards the buffer if it has changed.
+*/
+#if defined(CRYPTORAND_POSIX)
+#include <pthread.h>
+
+volatile cryptorand_uint32 cryptorand_g_fork_generation = 0;
+static volatile int cryptorand_g_atfork_registered = 0;
+
+static void cryptorand_on_fork_child(void)
+{
+    cryptorand_g_fork_generation += 1;
+
+    /* The thread holding the lock, if any, doesn't exist in the child. The generator it was initializing is still unpublished so it'll just be initialized again. */
+    cryptorand_g_lazy_init_lock = 0;
+}
+
+static void cryptorand_register_atfork(void)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    if (__sync_bool_compare_and_swap(&cryptorand_g_atfork_registered, 0, 1)) {
+        pthread_atfork(NULL, NULL, cryptorand_on_fork_child);
+    }
+#else
+    if (cryptorand_g_atfork_registered == 0) {
+        cryptorand_g_atfork_registered = 1;
+        pthread_atfork(NULL, NULL, cryptorand_on_fork_child);
+    }
+#endif
+}
+
+static cryptorand_uint32 cryptorand_get_fork_generation(void)
+{
+    return cryptorand_g_fork_generation;
+}
+#else
+static void cryptorand_register_atfork(void)
+{
+}
+
+static cryptorand_uint32 cryptorand_get_fork_generation(void)
+{
+    return 0;   /* No fork() on this platform. */
+}
+#endif
+
+#if defined(CRYPTORAND_WIN32)
+#include <windows.h>    /* For LoadLibrary(). */
+
+typedef LONG (WINAPI * CRYPTORAND_PFN_BCryptOpenAlgorithmProvider)(void** phAlgorithm, LPCWSTR pszAlgId, LPCWSTR pszImplementation, ULONG dwFlags);
+typedef LONG (WINAPI * CRYPTORAND_PFN_BCryptCloseAlgorithmProvider)(void* hAlgorithm, ULONG dwFlags);
+typedef LONG (WINAPI * CRYPTORAND_PFN_BCryptGenRandom)(void* hAlgorithm, unsigned char* pbBuffer, ULONG cbBuffer, ULONG dwFlags);
+
+#define CRYPTORAND_BCRYPT_RNG_ALGORITHM L"RNG"
+
+
+typedef BOOL (WINAPI * CRYPTORAND_PFN_CryptAcquireContextW)(void** phProv, LPCWSTR szContainer, LPCWSTR szProvider, DWORD dwProvType, DWORD dwFlags);
+typedef BOOL (WINAPI * CRYPTORAND_PFN_CryptReleaseContext)(void* hProv, DWORD dwFlags);
+typedef BOOL (WINAPI * CRYPTORAND_PFN_CryptGenRandom)(void* hProv, DWORD dwLen, BYTE* pbBuffer);
+
+#define CRYPTORAND_PROV_RSA_FULL        1
+#define CRYPTORAND_CRYPT_VERIFYCONTEXT  0xF0000000
+#define CRYPTORAND_CRYPT_SILENT         0x00000040
+
+static cryptorand_result cryptorand_init__win32(void* pUserData, cryptorand* pRNG)
+{
+    (void)pUserData;
+
+    /*
+    We first need to try using BCrypt which is the most modern version. If this fails it might mean
+    we're running on Windows XP in which case we'll fall back to CryptGenRandom().
+    */
+    CRYPTORAND_ZERO_OBJECT(&pRNG->win32);   /* For safety. */
+    {
+        HMODULE hBcryptDLL;
+
+        hBcryptDLL = LoadLibraryW(L"bcrypt.dll");
+        if (hBcryptDLL != NULL) {
+            pRNG->win32.hBcryptDLL                   = (void*)hBcryptDLL;
+            pRNG->win32.BCryptOpenAlgorithmProvider  = (cryptorand_proc)GetProcAddress(hBcryptDLL, "BCryptOpenAlgorithmProvider");
+            pRNG->win32.BCryptCloseAlgorithmProvider = (cryptorand_proc)GetProcAddress(hBcryptDLL, "BCryptCloseAlgorithmProvider");
+            pRNG->win32.BCryptGenRandom              = (cryptorand_proc)GetProcAddress(hBcryptDLL, "BCryptGenRandom");
+
+            if (pRNG->win32.BCryptOpenAlgorithmProvider != NULL && pRNG->win32.BCryptCloseAlgorithmProvider != NULL && pRNG->win32.BCryptGenRandom != NULL) {
+                if (((CRYPTORAND_PFN_BCryptOpenAlgorithmProvider)pRNG->win32.BCryptOpenAlgorithmProvider)(&pRNG->win32.hAlgorithm, CRYPTORAND_BCRYPT_RNG_ALGORITHM, NULL, 0) == 0) {
+                    return CRYPTORAND_SUCCESS;
+                } else {
+                    /* Failed to open provider. */
+                }
+            } else {
+                /* Failed to retrieve function addresses.*/
+            }
+        } else {
+            /* Failed to load DLL. */
+        }
+    }
+
+
+    /* Getting here means we're falling back to the old method. */
+    CRYPTORAND_ZERO_OBJECT(&pRNG->win32);   /* For safety. */
+    {
+        HMODULE hAdvapiDLL;
+
+        hAdvapiDLL = LoadLibraryW(L"advapi32.dll");
+        if (hAdvapiDLL != NULL) {
+            pRNG->win32.hAdvapiDLL           = (void*)hAdvapiDLL;
+            pRNG->win32.CryptAcquireContextW = (cryptorand_proc)GetProcAddress(hAdvapiDLL, "CryptAcquireContextW");
+            pRNG->win32.CryptReleaseContext  = (cryptorand_proc)GetProcAddress(hAdvapiDLL, "CryptReleaseContext");
+            pRNG->win32.CryptGenRandom       = (cryptorand_proc)GetProcAddress(hAdvapiDLL, "CryptGenRandom");
+
+            if (pRNG->win32.CryptAcquireContextW != NULL && pRNG->win32.CryptReleaseContext != NULL && pRNG->win32.CryptGenRandom != NULL) {
+                if (((CRYPTORAND_PFN_CryptAcquireContextW)pRNG->win32.CryptAcquireContextW)(&pRNG->win32.hProvider, NULL, NULL, CRYPTORAND_PROV_RSA_FULL, CRYPTORAND_CRYPT_VERIFYCONTEXT | CRYPTORAND_CRYPT_SILENT)) {
+                    return CRYPTORAND_SUCCESS;
+                } else {
+                    /* Failed to acquire context. */
+                }
+            } else {
+                /* Failed to retrieve function addresses.*/
+            }
+        } else {
+            /* Failed to load DLL. */
+        }
+    }
+
+
+    /* Getting here means both BCryptGenRandom() and CryptGenRandom() are unusable. */
     CRYPTORAND_ZERO_OBJECT(&pRNG->win32);
     return CRYPTORAND_ERROR;
 }
 
-static void cryptorand_uninit__win32(cryptorand* pRNG)
+static void cryptorand_uninit__win32(void* pUserData, cryptorand* pRNG)
+{
+    (void)pUserData;
+
+    if (pRNG->win32.hAlgorithm != NULL) {
+        ((CRYPTORAND_PFN_BCryptCloseAlgorithmProvider)pRNG->win32.BCryptCloseAlgorithmProvider)(pRNG->win32.hAlgorithm, 0);
+    } else if (pRNG->win32.hProvider != NULL) {
+        ((CRYPTORAND_PFN_CryptReleaseContext)pRNG->win32.CryptReleaseContext)(pRNG->win32.hProvider, 0);
+    }
+
+    if (pRNG->win32.hBcryptDLL != NULL) {
+        FreeLibrary((HMODULE)pRNG->win32.hBcryptDLL);
+    }
+    if (pRNG->win32.hAdvapiDLL != NULL) {
+        FreeLibrary((HMODULE)pRNG->win32.hAdvapiDLL);
+    }
+}
+
+/* Both BCryptGenRandom() and CryptGenRandom() take a 32-bit length so big requests need to be split. */
+#define CRYPTORAND_WIN32_MAX_CHUNK_SIZE 0xFFFFFFFF
+
+static cryptorand_result cryptorand_generate__win32(void* pUserData, cryptorand* pRNG, void* pBufferOut, size_t byteCount)
+{
+    unsigned char* pRunningBufferOut = (unsigned char*)pBufferOut;
+
+    (void)pUserData;
+
+    while (byteCount > 0) {
+        size_t chunkSize = byteCount;
+        if (chunkSize > CRYPTORAND_WIN32_MAX_CHUNK_SIZE) {
+            chunkSize = CRYPTORAND_WIN32_MAX_CHUNK_SIZE;
+        }
+
+        if (pRNG->win32.hAlgorithm != NULL) {
+            LONG result = ((CRYPTORAND_PFN_BCryptGenRandom)pRNG->win32.BCryptGenRandom)(pRNG->win32.hAlgorithm, pRunningBufferOut, (ULONG)chunkSize, 0);
+            if (result != 0) {
+                return CRYPTORAND_ERROR;
+            }
+        } else if (pRNG->win32.hProvider != NULL) {
+            if (!((CRYPTORAND_PFN_CryptGenRandom)pRNG->win32.CryptGenRandom)(pRNG->win32.hProvider, (DWORD)chunkSize, pRunningBufferOut)) {
+                return CRYPTORAND_ERROR;
+            }
+        } else {
+            return CRYPTORAND_INVALID_OPERATION;
+        }
+
+        pRunningBufferOut += chunkSize;
+        byteCount         -= chunkSize;
+    }
+
+    return CRYPTORAND_SUCCESS;
+}
+
+static const cryptorand_backend_vtable cryptorand_g_backend_vtable_win32 =
+{
+    cryptorand_init__win32,
+    cryptorand_uninit__win32,
+    cryptorand_generate__win32,
+    NULL
+};
+#endif
+
+#if defined(CRYPTORAND_URANDOM)
+#if !defined(CRYPTORAND_NO_STDIO)
+#include <stdio.h>
+
+static cryptorand_result cryptorand_init__urandom(void* pUserData, cryptorand* pRNG)
+{
+    (void)pUserData;
+
+    pRNG->urandom.pFile = fopen("/dev/urandom", "rb");
+    if (pRNG->urandom.pFile == NULL) {
+        return CRYPTORAND_ERROR;
+    }
+
+    /*
+    stdio would otherwise read ahead and hand out the rest of its buffer on later calls. That buffer is
+    copied into forked children so siblings would get the same bytes, and it would defeat both the
+    fork detection of the buffered mode and prediction resistance.
+    */
+    if (setvbuf((FILE*)pRNG->urandom.pFile, NULL, _IONBF, 0) != 0) {
+        fclose((FILE*)pRNG->urandom.pFile);
+        pRNG->urandom.pFile = NULL;
+        return CRYPTORAND_ERROR;
+    }
+
+    return CRYPTORAND_SUCCESS;
+}
+
+static void cryptorand_uninit__urandom(void* pUserData, cryptorand* pRNG)
+{
+    (void)pUserData;
+
+    if (pRNG->urandom.pFile == NULL) {
+        return;
+    }
+
+    fclose((FILE*)pRNG->urandom.pFile);
+}
+#elif !defined(CRYPTORAND_RAW_SYSCALLS)
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+
+#if !defined(CRYPTORAND_O_CLOEXEC)
+    #if defined(O_CLOEXEC)
+        #define CRYPTORAND_O_CLOEXEC    O_CLOEXEC
+    #else
+        #define CRYPTORAND_O_CLOEXEC    0
+    #endif
+#endif
+
+static cryptorand_result cryptorand_init__urandom(void* pUserData, cryptorand* pRNG)
+{
+    (void)pUserData;
+
+    do {
+        pRNG->urandom.fd = open("/dev/urandom", O_RDONLY | CRYPTORAND_O_CLOEXEC);
+    } while (pRNG->urandom.fd < 0 && errno == EINTR);
+
+    if (pRNG->urandom.fd < 0) {
+        return CRYPTORAND_ERROR;
+    }
+
+    return CRYPTORAND_SUCCESS;
+}
+
+static void cryptorand_uninit__urandom(void* pUserData, cryptorand* pRNG)
+{
+    (void)pUserData;
+
+    if (pRNG->urandom.fd < 0) {
+        return;
+    }
+
+    close(pRNG->urandom.fd);
+}
+#else
+#define CRYPTORAND_SYS_GETRANDOM_X86_64     318
+#define CRYPTORAND_SYS_GETRANDOM_AARCH64    278
+#define CRYPTORAND_EINTR                    4
+#define CRYPTORAND_ENOSYS                   38
+
+/* Returns the result of the syscall, which is a negative errno on failure. */
+static long cryptorand_getrandom__raw(void* pBuffer, size_t size)
+{
+    long result;
+
+#if defined(__x86_64__)
+    __asm__ __volatile__ ("syscall"
+        : "=a"(result)
+        : "a"((long)CRYPTORAND_SYS_GETRANDOM_X86_64), "D"(pBuffer), "S"(size), "d"(0L)
+        : "rcx", "r11", "memory");
+#else
+    register long x8 __asm__("x8") = CRYPTORAND_SYS_GETRANDOM_AARCH64;
+    register long x0 __asm__("x0") = (long)pBuffer;
+    register long x1 __asm__("x1") = (long)size;
+    register long x2 __asm__("x2") = 0;
+
+    __asm__ __volatile__ ("svc 0"
+        : "+r"(x0)
+        : "r"(x8), "r"(x1), "r"(x2)
+        : "memory", "cc");
+
+    result = x0;
+#endif
+
+    return result;
+}
+
+static cryptorand_result cryptorand_init__urandom(void* pUserData, cryptorand* pRNG)
+{
+    (void)pUserData;
+    (void)pRNG;
+
+    /* A zero byte request tells us whether or not the kernel has getrandom(). It was added in 3.17. */
+    if (cryptorand_getrandom__raw(NULL, 0) == -CRYPTORAND_ENOSYS) {
+        return CRYPTORAND_NOT_IMPLEMENTED;
+    }
+
+    return CRYPTORAND_SUCCESS;
+}
+
+static void cryptorand_uninit__urandom(void* pUserData, cryptorand* pRNG)
+{
+    (void)pUserData;
+    (void)pRNG;
+}
+#endif
+
+/*
+Linux will never return more than 32MB from a single read() of /dev/urandom. We read in chunks of this
+size so that huge requests map cleanly onto the underlying reads rather than having stdio split them
+up for us.
+*/
+#define CRYPTORAND_URANDOM_MAX_CHUNK_SIZE   (32*1024*1024)
+
+static cryptorand_result cryptorand_generate__urandom(void* pUserData, cryptorand* pRNG, void* pBufferOut, size_t byteCount)
+{
+    unsigned char* pRunningBufferOut = (unsigned char*)pBufferOut;
+
+    (void)pUserData;
+
+#if !defined(CRYPTORAND_NO_STDIO)
+    if (pRNG->urandom.pFile == NULL) {
+        return CRYPTORAND_INVALID_OPERATION;
+    }
+#elif !defined(CRYPTORAND_RAW_SYSCALLS)
+    if (pRNG->urandom.fd < 0) {
+        return CRYPTORAND_INVALID_OPERATION;
+    }
+#else
+    (void)pRNG;
+#endif
+
+    while (byteCount > 0) {
+        size_t chunkSize = byteCount;
+        if (chunkSize > CRYPTORAND_URANDOM_MAX_CHUNK_SIZE) {
+            chunkSize = CRYPTORAND_URANDOM_MAX_CHUNK_SIZE;
+        }
+
+    #if !defined(CRYPTORAND_NO_STDIO)
+        {
+            size_t bytesRead = fread(pRunningBufferOut, 1, chunkSize, (FILE*)pRNG->urandom.pFile);
+            if (bytesRead < chunkSize) {
+                return CRYPTORAND_ERROR;    /* Wasn't able to read all the data. Should never happen. */
+            }
+        }
+    #else
+        {
+            /* Unlike fread(), these can return early when interrupted by a signal so we may need to try again. */
+        #if !defined(CRYPTORAND_RAW_SYSCALLS)
+            ssize_t bytesRead = read(pRNG->urandom.fd, pRunningBufferOut, chunkSize);
+            if (bytesRead < 0 && errno == EINTR) {
+                continue;
+            }
+        #else
+            long bytesRead = cryptorand_getrandom__raw(pRunningBufferOut, chunkSize);
+            if (bytesRead == -CRYPTORAND_EINTR) {
+                continue;
+            }
+        #endif
+
+            if (bytesRead <= 0) {
+                return CRYPTORAND_ERROR;
+            }
+
+            chunkSize = (size_t)bytesRead;
+        }
+    #endif
+
+        pRunningBufferOut += chunkSize;
+        byteCount         -= chunkSize;
+    }
+
+    return CRYPTORAND_SUCCESS;
+}
+
+/*
+Anything written to /dev/urandom is mixed into the kernel's pool without being credited as entropy,
+which is exactly what we want for additional input. It's opened separately because the handle used
+for reading is read only. Not available with CRYPTORAND_RAW_SYSCALLS since it'd need the file system.
+*/
+#if !defined(CRYPTORAND_RAW_SYSCALLS)
+static cryptorand_result cryptorand_reseed__urandom(void* pUserData, cryptorand* pRNG, const void* pAdditionalInput, size_t additionalInputSize)
+{
+    const unsigned char* pRunningInput = (const unsigned char*)pAdditionalInput;
+#if !defined(CRYPTORAND_NO_STDIO)
+    FILE* pFile;
+    size_t bytesWritten;
+#else
+    int fd;
+#endif
+
+    (void)pUserData;
+    (void)pRNG;
+
+    if (additionalInputSize == 0) {
+        return CRYPTORAND_SUCCESS;
+    }
+
+#if !defined(CRYPTORAND_NO_STDIO)
+    pFile = fopen("/dev/urandom", "wb");
+    if (pFile == NULL) {
+        return CRYPTORAND_ERROR;
+    }
+
+    bytesWritten = fwrite(pRunningInput, 1, additionalInputSize, pFile);
+    if (fclose(pFile) != 0 || bytesWritten < additionalInputSize) {
+        return CRYPTORAND_IO_ERROR;
+    }
+#else
+    do {
+        fd = open("/dev/urandom", O_WRONLY | CRYPTORAND_O_CLOEXEC);
+    } while (fd < 0 && errno == EINTR);
+
+    if (fd < 0) {
+        return CRYPTORAND_ERROR;
+    }
+
+    while (additionalInputSize > 0) {
+        ssize_t bytesWritten = write(fd, pRunningInput, additionalInputSize);
+        if (bytesWritten < 0 && errno == EINTR) {
+            continue;
+        }
+
+        if (bytesWritten <= 0) {
+            close(fd);
+            return CRYPTORAND_IO_ERROR;
+        }
+
+        pRunningInput       += bytesWritten;
+        additionalInputSize -= (size_t)bytesWritten;
+    }
+
+    close(fd);
+#endif
+
+    return CRYPTORAND_SUCCESS;
+}
+#endif
+
+static const cryptorand_backend_vtable cryptorand_g_backend_vtable_urandom =
+{
+    cryptorand_init__urandom,
+    cryptorand_uninit__urandom,
+    cryptorand_generate__urandom,
+#if !defined(CRYPTORAND_RAW_SYSCALLS)
+    cryptorand_reseed__urandom
+#else
+    NULL
+#endif
+};
+#endif
+
+#if defined(CRYPTORAND_ARC4RANDOM) || defined(CRYPTORAND_ARC4RANDOM_WEAK)
+#if defined(CRYPTORAND_ARC4RANDOM_WEAK)
+#include <sys/utsname.h>
+
+/* The assembler names let us declare our own weak references without clashing with the declarations in the system headers, if there are any. */
+extern void cryptorand_arc4random_buf(void* pBuffer, size_t size) __asm__("arc4random_buf") __attribute__((weak));
+extern const char* cryptorand_gnu_get_libc_version(void) __asm__("gnu_get_libc_version") __attribute__((weak));
+
+static cryptorand_bool32 cryptorand_is_version_at_least(const char* pVersion, int major, int minor)
+{
+    int versionMajor = 0;
+    int versionMinor = 0;
+
+    while (*pVersion >= '0' && *pVersion <= '9') {
+        versionMajor = (versionMajor * 10) + (*pVersion - '0');
+        pVersion += 1;
+    }
+
+    if (*pVersion == '.') {
+        pVersion += 1;
+        while (*pVersion >= '0' && *pVersion <= '9') {
+            versionMinor = (versionMinor * 10) + (*pVersion - '0');
+            pVersion += 1;
+        }
+    }
+
+    return versionMajor > major || (versionMajor == major && versionMinor >= minor);
+}
+
+static cryptorand_bool32 cryptorand_has_vdso_arc4random(void)
+{
+    struct utsname name;
+
+    if (cryptorand_arc4random_buf == NULL || cryptorand_gnu_get_libc_version == NULL) {
+        return CRYPTORAND_FALSE;    /* Not glibc, or a version without arc4random_buf(). */
+    }
+
+    if (!cryptorand_is_version_at_least(cryptorand_gnu_get_libc_version(), 2, 41)) {
+        return CRYPTORAND_FALSE;
+    }
+
+    if (uname(&name) != 0 || !cryptorand_is_version_at_least(name.release, 6, 11)) {
+        return CRYPTORAND_FALSE;
+    }
+
+    return CRYPTORAND_TRUE;
+}
+#else
+#include <stdlib.h>
+#define cryptorand_arc4random_buf arc4random_buf
+#endif
+
+static cryptorand_result cryptorand_init__arc4random(void* pUserData, cryptorand* pRNG)
+{
+    (void)pUserData;
+    (void)pRNG;
+
+#if defined(CRYPTORAND_ARC4RANDOM_WEAK)
+    if (!cryptorand_has_vdso_arc4random()) {
+        return CRYPTORAND_NOT_IMPLEMENTED;  /* Not available, or not worth using. Fall back to /dev/urandom. */
+    }
+#endif
+
+    return CRYPTORAND_SUCCESS;
+}
+
+static void cryptorand_uninit__arc4random(void* pUserData, cryptorand* pRNG)
+{
+    (void)pUserData;
+    (void)pRNG;
+}
+
+static cryptorand_result cryptorand_generate__arc4random(void* pUserData, cryptorand* pRNG, void* pBufferOut, size_t byteCount)
+{
+    /* The arc4random() family is always successful. */
+    cryptorand_arc4random_buf(pBufferOut, byteCount);
+
+    (void)pUserData;
+    (void)pRNG;
+    return CRYPTORAND_SUCCESS;
+}
+
+static const cryptorand_backend_vtable cryptorand_g_backend_vtable_arc4random =
+{
+    cryptorand_init__arc4random,
+    cryptorand_uninit__arc4random,
+    cryptorand_generate__arc4random,
+    NULL
+};
+#endif
+
+
+/*
+The stock backends, in order of priority. The first one that initializes successfully is used.
+*/
+static const cryptorand_backend_vtable* const cryptorand_g_stock_backend_vtables[] =
+{
+#if defined(CRYPTORAND_WIN32)
+    &cryptorand_g_backend_vtable_win32,
+#endif
+#if defined(CRYPTORAND_ARC4RANDOM_WEAK)
+    &cryptorand_g_backend_vtable_arc4random,   /* Before /dev/urandom because it's faster when available. */
+#endif
+#if defined(CRYPTORAND_URANDOM)
+    &cryptorand_g_backend_vtable_urandom,
+#endif
+#if defined(CRYPTORAND_ARC4RANDOM)
+    &cryptorand_g_backend_vtable_arc4random,
+#endif
+    NULL    /* Terminator. Also makes sure the array is never empty on unsupported platforms. */
+};
+
+static cryptorand_result cryptorand_init_backend(const cryptorand_backend_vtable* pBackendVTable, void* pBackendUserData, cryptorand* pRNG)
+{
+    cryptorand_result result;
+
+    if (pBackendVTable == NULL || pBackendVTable->onInit == NULL || pBackendVTable->onGenerate == NULL) {
+        return CRYPTORAND_INVALID_ARGS;
+    }
+
+    result = pBackendVTable->onInit(pBackendUserData, pRNG);
+    if (result != CRYPTORAND_SUCCESS) {
+        return result;
+    }
+
+    pRNG->pBackendUserData = pBackendUserData;
+
+    return CRYPTORAND_SUCCESS;
+}
+
+
+/*
+SP 800-90B continuous health tests. These are run over the raw output of the backend, with the state
+carried over between calls so that a stuck source is detected even when it's being read from in
+small pieces.
+
+The tests are run 8 bytes at a time. The adaptive proportion test counts matching bytes in a word
+with the usual SWAR zero byte trick. The repetition count test only needs to be done byte by byte if
+the word contains a pair of equal neighbours or continues the current run, which for healthy data is
+only a few percent of words. Everything else falls back to the byte by byte version.
+*/
+#define CRYPTORAND_HEALTH_APT_WINDOW_SIZE   512
+
+static cryptorand_bool32 cryptorand_health_test_byte(cryptorand* pRNG, cryptorand_uint8 b)
+{
+    if (b == pRNG->health.rctValue) {
+        pRNG->health.rctCount += 1;
+        if (pRNG->health.rctCount >= CRYPTORAND_HEALTH_RCT_CUTOFF) {
+            return CRYPTORAND_FALSE;
+        }
+    } else {
+        pRNG->health.rctValue = b;
+        pRNG->health.rctCount = 1;
+    }
+
+    if (pRNG->health.aptIndex == 0) {
+        pRNG->health.aptValue = b;
+        pRNG->health.aptCount = 1;
+    } else if (b == pRNG->health.aptValue) {
+        pRNG->health.aptCount += 1;
+        if (pRNG->health.aptCount >= CRYPTORAND_HEALTH_APT_CUTOFF) {
+            return CRYPTORAND_FALSE;
+        }
+    }
+
+    pRNG->health.aptIndex += 1;
+    if (pRNG->health.aptIndex == CRYPTORAND_HEALTH_APT_WINDOW_SIZE) {
+        pRNG->health.aptIndex = 0;
+    }
+
+    return CRYPTORAND_TRUE;
+}
+
+static cryptorand_result cryptorand_health_test(cryptorand* pRNG, const void* pData, size_t dataSize)
+{
+    const cryptorand_uint64 ones = ((cryptorand_uint64)0x01010101 << 32) | 0x01010101;
+    const cryptorand_uint64 low7 = ones * 0x7F;
+    const cryptorand_uint64 neighbourMask = ~(cryptorand_uint64)0 >> 8;   /* The lane which has nothing to compare against, regardless of endianness. */
+    const cryptorand_uint8* pRunningData = (const cryptorand_uint8*)pData;
+
+    if (pRNG->health.failed) {
+        return CRYPTORAND_HEALTH_FAILURE;
+    }
+
+    while (dataSize > 0) {
+        /* The word-at-a-time path requires the adaptive proportion window to be at a word boundary. */
+        if (dataSize >= 8 && (pRNG->health.aptIndex & 7) == 0) {
+            /* Work on local copies so the compiler doesn't need to assume the data aliases the state. */
+            cryptorand_uint8  rctValue = pRNG->health.rctValue;
+            cryptorand_uint8  aptValue = pRNG->health.aptValue;
+            cryptorand_uint32 aptCount = pRNG->health.aptCount;
+            cryptorand_uint32 aptIndex = pRNG->health.aptIndex;
+            cryptorand_uint64 aptPattern = ones * aptValue;
+            const cryptorand_uint8* pFirstWord = pRunningData;
+
+            while (dataSize >= 8) {
+                cryptorand_uint64 w;
+                cryptorand_uint64 x;
+                cryptorand_uint64 zeros;
+
+                CRYPTORAND_COPY_MEMORY(&w, pRunningData, 8);
+
+                x = w ^ (w >> 8);
+                zeros = ~(((x & low7) + low7) | x | low7) & neighbourMask;
+                if (zeros != 0 || pRunningData[0] == rctValue) {
+                    break;  /* Possible run. Needs to be done the slow way. */
+                }
+
+                /* No run in this word. The current run becomes the last byte. */
+                rctValue = pRunningData[7];
+
+                if (aptIndex == 0) {
+                    aptValue   = pRunningData[0];
+                    aptPattern = ones * aptValue;
+                    aptCount   = 0;   /* The first byte is counted below. */
+                }
+
+                x = w ^ aptPattern;
+                zeros = ~(((x & low7) + low7) | x | low7);
+                aptCount += (cryptorand_uint32)(((zeros >> 7) * ones) >> 56);
+                if (aptCount >= CRYPTORAND_HEALTH_APT_CUTOFF) {
+                    pRNG->health.failed = CRYPTORAND_TRUE;
+                    return CRYPTORAND_HEALTH_FAILURE;
+                }
+
+                aptIndex = (aptIndex + 8) & (CRYPTORAND_HEALTH_APT_WINDOW_SIZE - 1);
+
+                pRunningData += 8;
+                dataSize     -= 8;
+            }
+
+            if (pRunningData != pFirstWord) {
+                pRNG->health.rctCount = 1;  /* At least one word was processed which means the run was reset. */
+            }
+
+            pRNG->health.rctValue = rctValue;
+            pRNG->health.aptValue = aptValue;
+            pRNG->health.aptCount = aptCount;
+            pRNG->health.aptIndex = aptIndex;
+
+            if (dataSize == 0) {
+                break;
+            }
+        }
+
+        /* Getting here means we need to do it the slow way for this word. */
+        {
+            size_t i;
+            size_t count = (dataSize < 8) ? dataSize : 8;
+
+            for (i = 0; i < count; i += 1) {
+                if (!cryptorand_health_test_byte(pRNG, pRunningData[i])) {
+                    pRNG->health.failed = CRYPTORAND_TRUE;
+                    return CRYPTORAND_HEALTH_FAILURE;
+                }
+
+                /* Realign so the next iteration can take the fast path. */
+                if ((pRNG->health.aptIndex & 7) == 0) {
+                    count = i + 1;
+                }
+            }
+
+            pRunningData += count;
+            dataSize     -= count;
+        }
+    }
+
+    return CRYPTORAND_SUCCESS;
+}
+
+/*
+Monotonic time in nanoseconds for the latency histogram. Returns 0 on platforms we don't have a
+clock for, in which case everything lands in the first bucket.
+*/
+#if defined(CRYPTORAND_WIN32)
+static cryptorand_uint64 cryptorand_time_ns(void)
+{
+    LARGE_INTEGER counter;
+    LARGE_INTEGER frequency;
+
+    if (!QueryPerformanceCounter(&counter) || !QueryPerformanceFrequency(&frequency) || frequency.QuadPart == 0) {
+        return 0;
+    }
+
+    return (cryptorand_uint64)((double)counter.QuadPart * (1000000000.0 / (double)frequency.QuadPart));
+}
+#elif defined(CRYPTORAND_POSIX)
+#include <time.h>
+
+static cryptorand_uint64 cryptorand_time_ns(void)
+{
+    struct timespec ts;
+
+    if (clock_gettime(CLOCK_MONOTONIC, &ts) != 0) {
+        return 0;
+    }
+
+    return (cryptorand_uint64)ts.tv_sec * 1000000000 + (cryptorand_uint64)ts.tv_nsec;
+}
+#else
+static cryptorand_uint64 cryptorand_time_ns(void)
+{
+    return 0;
+}
+#endif
+
+static void cryptorand_record_latency(cryptorand* pRNG, cryptorand_uint64 durationInNanoseconds)
+{
+    cryptorand_uint32 iBucket = 0;
+
+    while (durationInNanoseconds > 1 && iBucket < CRYPTORAND_LATENCY_HISTOGRAM_SIZE - 1) {
+        durationInNanoseconds >>= 1;
+        iBucket += 1;
+    }
+
+    CRYPTORAND_STATS_ADD(pRNG, latencyHistogram[iBucket], 1);
+}
+
+static cryptorand_result cryptorand_generate_from_backend(cryptorand* pRNG, void* pBufferOut, size_t byteCount)
+{
+    cryptorand_result result;
+    cryptorand* pBackendRNG = (pRNG->pParent != NULL) ? pRNG->pParent : pRNG;  /* The backend state of a derived generator lives in the parent. */
+    cryptorand_uint64 startTime = 0;
+
+    CRYPTORAND_STATS_ADD(pRNG, backendReadCount, 1);
+
+    if (pRNG->enableLatencyHistogram) {
+        startTime = cryptorand_time_ns();
+    }
+
+    CRYPTORAND_PROBE1(backend_generate_entry, byteCount);
+    result = pBackendRNG->pBackendVTable->onGenerate(pBackendRNG->pBackendUserData, pBackendRNG, pBufferOut, byteCount);
+    CRYPTORAND_PROBE2(backend_generate_exit, byteCount, (int)result);
+
+    if (pRNG->enableLatencyHistogram) {
+        cryptorand_record_latency(pRNG, cryptorand_time_ns() - startTime);
+    }
+
+    if (result == CRYPTORAND_SUCCESS) {
+        CRYPTORAND_STATS_ADD(pRNG, backendBytesRead, byteCount);
+
+        if (pRNG->health.enabled) {
+            result = cryptorand_health_test(pRNG, pBufferOut, byteCount);
+            if (result == CRYPTORAND_HEALTH_FAILURE) {
+                CRYPTORAND_STATS_ADD(pRNG, healthFailureCount, 1);
+                CRYPTORAND_PROBE1(health_failure, byteCount);
+            }
+        }
+    }
+
+    if (pRNG->onStats != NULL) {
+        cryptorand_stats stats;
+        cryptorand_get_stats(pRNG, &stats);
+        pRNG->onStats(pRNG->pStatsUserData, pRNG, &stats);
+    }
+
+    return result;
+}
+
+
+static cryptorand_result cryptorand_refill_buffer(cryptorand* pRNG)
+{
+    cryptorand_result result;
+
+    CRYPTORAND_STATS_ADD(pRNG, bufferRefillCount, 1);
+    CRYPTORAND_PROBE1(buffer_refill, pRNG->buffer.capacity);
+
+    result = cryptorand_generate_from_backend(pRNG, pRNG->buffer.pData, pRNG->buffer.capacity);
+    if (result != CRYPTORAND_SUCCESS) {
+        CRYPTORAND_ZERO_MEMORY(pRNG->buffer.pData, pRNG->buffer.capacity);
+        pRNG->buffer.cursor = pRNG->buffer.capacity;
+        return result;
+    }
+
+    pRNG->buffer.cursor = 0;
+
+    return CRYPTORAND_SUCCESS;
+}
+
+static void cryptorand_read_from_buffer(cryptorand* pRNG, void* pBufferOut, size_t byteCount)
+{
+    /* Bytes are zeroed as they're consumed so they're never handed out twice and don't linger in memory. */
+    CRYPTORAND_COPY_MEMORY(pBufferOut, pRNG->buffer.pData + pRNG->buffer.cursor, byteCount);
+    CRYPTORAND_ZERO_MEMORY(pRNG->buffer.pData + pRNG->buffer.cursor, byteCount);
+    pRNG->buffer.cursor += byteCount;
+}
+
+/* *pIsHit is set when the request was served entirely from the buffer. The caller does the counting. */
+static cryptorand_result cryptorand_generate_buffered(cryptorand* pRNG, void* pBufferOut, size_t byteCount, cryptorand_bool32* pIsHit)
+{
+    cryptorand_result result;
+    unsigned char* pRunningBufferOut = (unsigned char*)pBufferOut;
+    size_t available;
+
+    *pIsHit = CRYPTORAND_FALSE;
+
+    /* If we've been forked, the buffer has the same content as the parent's and needs to be thrown away. */
+    if (pRNG->buffer.forkGeneration != cryptorand_get_fork_generation()) {
+        pRNG->buffer.forkGeneration = cryptorand_get_fork_generation();
+        CRYPTORAND_ZERO_MEMORY(pRNG->buffer.pData, pRNG->buffer.capacity);
+        pRNG->buffer.cursor = pRNG->buffer.capacity;
+    }
+
+    available = pRNG->buffer.capacity - pRNG->buffer.cursor;
+    if (byteCount <= available) {
+        cryptorand_read_from_buffer(pRNG, pRunningBufferOut, byteCount);
+        *pIsHit = CRYPTORAND_TRUE;
+        return CRYPTORAND_SUCCESS;
+    }
+
+    /* Use up whatever is left in the buffer first. */
+    cryptorand_read_from_buffer(pRNG, pRunningBufferOut, available);
+    pRunningBufferOut += available;
+    byteCount         -= available;
+
+    /* Requests that are at least as big as the buffer go straight to the backend. */
+    if (byteCount >= pRNG->buffer.capacity) {
+        return cryptorand_generate_from_backend(pRNG, pRunningBufferOut, byteCount);
+    }
+
+    result = cryptorand_refill_buffer(pRNG);
+    if (result != CRYPTORAND_SUCCESS) {
+        return result;
+    }
+
+    cryptorand_read_from_buffer(pRNG, pRunningBufferOut, byteCount);
+
+    return CRYPTORAND_SUCCESS;
+}
+
+
+CRYPTORAND_API cryptorand_config cryptorand_config_init(void)
+{
+    cryptorand_config config;
+
+    CRYPTORAND_ZERO_OBJECT(&config);
+
+    return config;
+}
+
+
+typedef struct
+{
+    size_t sizeInBytes;
+    size_t bufferOffset;
+} cryptorand_heap_layout;
+
+static cryptorand_result cryptorand_get_heap_layout(const cryptorand_config* pConfig, cryptorand_heap_layout* pHeapLayout)
+{
+    CRYPTORAND_ZERO_OBJECT(pHeapLayout);
+
+    /* Buffer. */
+    pHeapLayout->bufferOffset = pHeapLayout->sizeInBytes;
+    pHeapLayout->sizeInBytes += pConfig->bufferSizeInBytes;
+
+    return CRYPTORAND_SUCCESS;
+}
+
+CRYPTORAND_API cryptorand_result cryptorand_get_heap_size(const cryptorand_config* pConfig, size_t* pHeapSizeInBytes)
+{
+    cryptorand_result result;
+    cryptorand_heap_layout heapLayout;
+    cryptorand_config defaultConfig;
+
+    if (pHeapSizeInBytes == NULL) {
+        return CRYPTORAND_INVALID_ARGS;
+    }
+
+    *pHeapSizeInBytes = 0;
+
+    if (pConfig == NULL) {
+        defaultConfig = cryptorand_config_init();
+        pConfig = &defaultConfig;
+    }
+
+    result = cryptorand_get_heap_layout(pConfig, &heapLayout);
+    if (result != CRYPTORAND_SUCCESS) {
+        return result;
+    }
+
+    *pHeapSizeInBytes = heapLayout.sizeInBytes;
+
+    return CRYPTORAND_SUCCESS;
+}
+
+/*
+The vtable is published last so this can be used to initialize a statically initialized generator in
+place while other threads are checking whether or not it's been initialized.
+*/
+static cryptorand_result cryptorand_init_preallocated_internal(const cryptorand_config* pConfig, void* pHeap, cryptorand_bool32 ownsHeap, cryptorand* pParent, cryptorand* pRNG)
+{
+    cryptorand_result result;
+    cryptorand_heap_layout heapLayout;
+    cryptorand_config defaultConfig;
+    cryptorand_uint32 iBackend;
+    const cryptorand_backend_vtable* pBackendVTable = NULL;
+
+    if (pRNG == NULL) {
+        return CRYPTORAND_INVALID_ARGS;
+    }
+
+    cryptorand_zero_object(pRNG);
+
+    if (pConfig == NULL) {
+        defaultConfig = cryptorand_config_init();
+        pConfig = &defaultConfig;
+    }
+
+    result = cryptorand_get_heap_layout(pConfig, &heapLayout);
+    if (result != CRYPTORAND_SUCCESS) {
+        return result;
+    }
+
+    if (heapLayout.sizeInBytes > 0 && pHeap == NULL) {
+        return CRYPTORAND_INVALID_ARGS;
+    }
+
+    result = cryptorand_allocation_callbacks_init_copy(&pRNG->allocationCallbacks, &pConfig->allocationCallbacks);
+    if (result != CRYPTORAND_SUCCESS) {
+        return result;
+    }
+
+    result = CRYPTORAND_NOT_IMPLEMENTED;
+
+    /* Derived generators share the parent's backend rather than initializing their own. */
+    if (pParent != NULL) {
+        if (pParent->pParent != NULL) {
+            pParent = pParent->pParent;
+        }
+
+        pBackendVTable         = cryptorand_load_backend_vtable(pParent);
+        pRNG->pBackendUserData = pParent->pBackendUserData;
+        pRNG->pParent          = pParent;
+        result = CRYPTORAND_SUCCESS;
+    }
+
+    /* Custom backends take priority. */
+    for (iBackend = 0; pBackendVTable == NULL && iBackend < pConfig->customBackendCount; iBackend += 1) {
+        if (pConfig->ppCustomBackendVTables == NULL) {
+            break;
+        }
+
+        result = cryptorand_init_backend(pConfig->ppCustomBackendVTables[iBackend], pConfig->pCustomBackendUserData, pRNG);
+        if (result == CRYPTORAND_SUCCESS) {
+            pBackendVTable = pConfig->ppCustomBackendVTables[iBackend];
+        }
+    }
+
+    /* Fall back to the stock backends if none of the custom backends could be used. */
+    for (iBackend = 0; pBackendVTable == NULL && cryptorand_g_stock_backend_vtables[iBackend] != NULL; iBackend += 1) {
+        result = cryptorand_init_backend(cryptorand_g_stock_backend_vtables[iBackend], NULL, pRNG);
+        if (result == CRYPTORAND_SUCCESS) {
+            pBackendVTable = cryptorand_g_stock_backend_vtables[iBackend];
+        }
+    }
+
+    /* The personalization string is only for newly initialized backends. A derived generator doesn't own its backend. */
+    if (result == CRYPTORAND_SUCCESS && pParent == NULL && pConfig->personalizationSizeInBytes > 0 && pBackendVTable->onReseed != NULL) {
+        if (pConfig->pPersonalization == NULL) {
+            result = CRYPTORAND_INVALID_ARGS;
+        } else {
+            result = pBackendVTable->onReseed(pRNG->pBackendUserData, pRNG, pConfig->pPersonalization, pConfig->personalizationSizeInBytes);
+        }
+
+        if (result != CRYPTORAND_SUCCESS && pBackendVTable->onUninit != NULL) {
+            pBackendVTable->onUninit(pRNG->pBackendUserData, pRNG);
+        }
+    }
+
+    CRYPTORAND_PROBE1(init, (int)result);
+
+    if (result != CRYPTORAND_SUCCESS) {
+        cryptorand_zero_object(pRNG);   /* Make sure the caller is given a blank object on failure. */
+        return result;
+    }
+
+    pRNG->_pHeap         = pHeap;
+    pRNG->_ownsHeap      = ownsHeap;
+    pRNG->health.enabled = pConfig->enableHealthTests;
+
+    pRNG->enableLatencyHistogram = pConfig->enableLatencyHistogram;
+    pRNG->onStats                = pConfig->onStats;
+    pRNG->pStatsUserData         = pConfig->pStatsUserData;
+
+    /* The buffer starts off empty. It'll be filled on the first request that needs it. */
+    if (pConfig->bufferSizeInBytes > 0) {
+        pRNG->buffer.pData    = (cryptorand_uint8*)pHeap + heapLayout.bufferOffset;
+        pRNG->buffer.capacity = pConfig->bufferSizeInBytes;
+        pRNG->buffer.cursor   = pRNG->buffer.capacity;
+
+        CRYPTORAND_ZERO_MEMORY(pRNG->buffer.pData, pRNG->buffer.capacity);
+    }
+
+    /* Always registered, even when not buffering, because the C++ wrapper does its own buffering. */
+    cryptorand_register_atfork();
+    pRNG->buffer.forkGeneration = cryptorand_get_fork_generation();
+
+    cryptorand_store_backend_vtable(pRNG, pBackendVTable);
+
+    return CRYPTORAND_SUCCESS;
+}
+
+CRYPTORAND_API cryptorand_result cryptorand_init_preallocated(const cryptorand_config* pConfig, void* pHeap, cryptorand* pRNG)
+{
+    return cryptorand_init_preallocated_internal(pConfig, pHeap, CRYPTORAND_FALSE, NULL, pRNG);
+}
+
+static cryptorand_result cryptorand_init_internal(const cryptorand_config* pConfig, cryptorand* pParent, cryptorand* pRNG)
+{
+    cryptorand_result result;
+    size_t heapSizeInBytes;
+    void* pHeap = NULL;
+    cryptorand_allocation_callbacks allocationCallbacks;
+
+    if (pRNG == NULL) {
+        return CRYPTORAND_INVALID_ARGS;
+    }
+
+    cryptorand_zero_object(pRNG);
+
+    result = cryptorand_get_heap_size(pConfig, &heapSizeInBytes);
+    if (result != CRYPTORAND_SUCCESS) {
+        return result;
+    }
+
+    result = cryptorand_allocation_callbacks_init_copy(&allocationCallbacks, (pConfig != NULL) ? &pConfig->allocationCallbacks : NULL);
+    if (result != CRYPTORAND_SUCCESS) {
+        return result;
+    }
+
+    if (heapSizeInBytes > 0) {
+        pHeap = cryptorand_malloc(heapSizeInBytes, &allocationCallbacks);
+        if (pHeap == NULL) {
+            return CRYPTORAND_OUT_OF_MEMORY;
+        }
+    }
+
+    result = cryptorand_init_preallocated_internal(pConfig, pHeap, CRYPTORAND_TRUE, pParent, pRNG);
+    if (result != CRYPTORAND_SUCCESS) {
+        cryptorand_free(pHeap, &allocationCallbacks);
+        return result;
+    }
+
+    return CRYPTORAND_SUCCESS;
+}
+
+CRYPTORAND_API cryptorand_result cryptorand_init(cryptorand* pRNG)
+{
+    return cryptorand_init_ex(NULL, pRNG);
+}
+
+CRYPTORAND_API cryptorand_result cryptorand_init_ex(const cryptorand_config* pConfig, cryptorand* pRNG)
+{
+    return cryptorand_init_internal(pConfig, NULL, pRNG);
+}
+
+/*
+Lazy initialization. A zeroed generator is initialized in place with the default config the first
+time it's used. See the atomics section above for how it's published.
+*/
+static cryptorand_result cryptorand_init_lazy(cryptorand* pRNG)
+{
+    cryptorand_result result = CRYPTORAND_SUCCESS;
+
+    /* Registered before taking the lock so that a fork() while it's held always resets it in the child. */
+    cryptorand_register_atfork();
+
+    cryptorand_lazy_init_lock();
+    {
+        /* Another thread may have got here first. */
+        if (cryptorand_load_backend_vtable(pRNG) == NULL) {
+            result = cryptorand_init_internal(NULL, NULL, pRNG);
+        }
+    }
+    cryptorand_lazy_init_unlock();
+
+    return result;
+}
+
+CRYPTORAND_API cryptorand* cryptorand_default(void)
+{
+    static cryptorand rng = CRYPTORAND_STATIC_INIT;
+    return &rng;
+}
+
+/*
+Generators are left pointing at this after cryptorand_uninit() so that using one afterwards fails
+rather than quietly initializing a new backend that would never be released.
+*/
+static cryptorand_result cryptorand_generate__uninitialized(void* pUserData, cryptorand* pRNG, void* pBufferOut, size_t byteCount)
+{
+    (void)pUserData;
+    (void)pRNG;
+    (void)pBufferOut;
+    (void)byteCount;
+    return CRYPTORAND_INVALID_OPERATION;
+}
+
+static cryptorand_result cryptorand_reseed__uninitialized(void* pUserData, cryptorand* pRNG, const void* pAdditionalInput, size_t additionalInputSize)
+{
+    (void)pUserData;
+    (void)pRNG;
+    (void)pAdditionalInput;
+    (void)additionalInputSize;
+    return CRYPTORAND_INVALID_OPERATION;
+}
+
+static const cryptorand_backend_vtable cryptorand_g_backend_vtable_uninitialized =
+{
+    NULL,
+    NULL,
+    cryptorand_generate__uninitialized,
+    cryptorand_reseed__uninitialized
+};
+
+/* A parent that's been uninitialized has no backend to share, whereas a zero initialized one is initialized now. */
+static cryptorand_result cryptorand_prepare_parent(cryptorand* pParent)
+{
+    const cryptorand_backend_vtable* pBackendVTable = cryptorand_load_backend_vtable(pParent);
+
+    if (pBackendVTable == &cryptorand_g_backend_vtable_uninitialized) {
+        return CRYPTORAND_INVALID_OPERATION;
+    }
+
+    if (pBackendVTable == NULL) {
+        return cryptorand_init_lazy(pParent);
+    }
+
+    return CRYPTORAND_SUCCESS;
+}
+
+CRYPTORAND_API cryptorand_result cryptorand_derive(cryptorand* pParent, const cryptorand_config* pConfig, cryptorand* pChild)
+{
+    cryptorand_result result;
+
+    if (pParent == NULL) {
+        return CRYPTORAND_INVALID_ARGS;
+    }
+
+    result = cryptorand_prepare_parent(pParent);
+    if (result != CRYPTORAND_SUCCESS) {
+        return result;
+    }
+
+    return cryptorand_init_internal(pConfig, pParent, pChild);
+}
+
+CRYPTORAND_API cryptorand_result cryptorand_derive_preallocated(cryptorand* pParent, const cryptorand_config* pConfig, void* pHeap, cryptorand* pChild)
+{
+    cryptorand_result result;
+
+    if (pParent == NULL) {
+        return CRYPTORAND_INVALID_ARGS;
+    }
+
+    result = cryptorand_prepare_parent(pParent);
+    if (result != CRYPTORAND_SUCCESS) {
+        return result;
+    }
+
+    return cryptorand_init_preallocated_internal(pConfig, pHeap, CRYPTORAND_FALSE, pParent, pChild);
+}
+
+CRYPTORAND_API void cryptorand_uninit(cryptorand* pRNG)
+{
+    if (pRNG == NULL) {
+        return;
+    }
+
+    if (pRNG->pParent == NULL && pRNG->pBackendVTable != NULL && pRNG->pBackendVTable->onUninit != NULL) {
+        pRNG->pBackendVTable->onUninit(pRNG->pBackendUserData, pRNG);
+    }
+
+    /* Don't leave random data lying around in freed memory. */
+    if (pRNG->buffer.pData != NULL) {
+        CRYPTORAND_ZERO_MEMORY(pRNG->buffer.pData, pRNG->buffer.capacity);
+    }
+
+    if (pRNG->_ownsHeap) {
+        cryptorand_free(pRNG->_pHeap, &pRNG->allocationCallbacks);
+    }
+
+    cryptorand_zero_object(pRNG);
+    cryptorand_store_backend_vtable(pRNG, &cryptorand_g_backend_vtable_uninitialized);
+}
+
+CRYPTORAND_API cryptorand_result cryptorand_generate(cryptorand* pRNG, void* pBufferOut, size_t byteCount)
+{
+    return cryptorand_generate_ex(pRNG, pBufferOut, byteCount, 0);
+}
+
+CRYPTORAND_API cryptorand_result cryptorand_generate_ex(cryptorand* pRNG, void* pBufferOut, size_t byteCount, cryptorand_uint32 flags)
+{
+    cryptorand_result result;
+
+    if (pRNG == NULL || pBufferOut == NULL) {
+        return CRYPTORAND_INVALID_ARGS;
+    }
+
+    if (cryptorand_load_backend_vtable(pRNG) == NULL) {
+        result = cryptorand_init_lazy(pRNG);
+        if (result != CRYPTORAND_SUCCESS) {
+            CRYPTORAND_ZERO_MEMORY(pBufferOut, byteCount);
+            return result;
+        }
+    }
+
+    CRYPTORAND_STATS_ADD(pRNG, generateCount, 1);
+
+    if (pRNG->health.failed) {
+        result = CRYPTORAND_HEALTH_FAILURE;
+    } else if (pRNG->buffer.capacity > 0 && (flags & CRYPTORAND_GENERATE_PREDICTION_RESISTANCE) == 0) {
+        cryptorand_bool32 isHit;
+
+        result = cryptorand_generate_buffered(pRNG, pBufferOut, byteCount, &isHit);
+        if (isHit) {
+            CRYPTORAND_STATS_ADD(pRNG, bufferHitCount, 1);
+        }
+    } else {
+        if ((flags & CRYPTORAND_GENERATE_PREDICTION_RESISTANCE) != 0) {
+            CRYPTORAND_PROBE2(reseed, byteCount, 1);
+        }
+
+        result = cryptorand_generate_from_backend(pRNG, pBufferOut, byteCount);
+    }
+
+    /*
+    If an error occurred, make sure everything is cleared to zero to make it clear to the caller that
+    the content in the buffer is not valid.
+    */
+    if (result != CRYPTORAND_SUCCESS) {
+        CRYPTORAND_ZERO_MEMORY(pBufferOut, byteCount);
+        CRYPTORAND_STATS_ADD(pRNG, failureCount, 1);
+        CRYPTORAND_PROBE2(error, byteCount, (int)result);
+    } else {
+        CRYPTORAND_STATS_ADD(pRNG, bytesGenerated, byteCount);
+    }
+
+    return result;
+}
+
+static cryptorand_result cryptorand_generate_v_unbuffered(cryptorand* pRNG, const cryptorand_iovec* pVecs, size_t count)
+{
+    cryptorand_result result = CRYPTORAND_SUCCESS;
+    unsigned char pBlock[CRYPTORAND_GENERATE_V_BLOCK_SIZE];
+    size_t iVec = 0;
+
+    while (iVec < count) {
+        size_t blockSize = 0;
+        size_t iVecEnd;
+        size_t blockCursor;
+
+        /* Big buffers aren't worth copying so they go straight to the backend. */
+        if (pVecs[iVec].size >= sizeof(pBlock)) {
+            result = cryptorand_generate_from_backend(pRNG, pVecs[iVec].pData, pVecs[iVec].size);
+            if (result != CRYPTORAND_SUCCESS) {
+                break;
+            }
+
+            iVec += 1;
+            continue;
+        }
+
+        /* Gather as many of the following small buffers as will fit in the block. */
+        for (iVecEnd = iVec; iVecEnd < count && pVecs[iVecEnd].size < sizeof(pBlock) && blockSize + pVecs[iVecEnd].size <= sizeof(pBlock); iVecEnd += 1) {
+            blockSize += pVecs[iVecEnd].size;
+        }
+
+        if (blockSize > 0) {
+            result = cryptorand_generate_from_backend(pRNG, pBlock, blockSize);
+            if (result != CRYPTORAND_SUCCESS) {
+                break;
+            }
+        }
+
+        for (blockCursor = 0; iVec < iVecEnd; iVec += 1) {
+            if (pVecs[iVec].size == 0) {
+                continue;   /* Empty entries are allowed to have a NULL pointer. */
+            }
+
+            CRYPTORAND_COPY_MEMORY(pVecs[iVec].pData, pBlock + blockCursor, pVecs[iVec].size);
+            blockCursor += pVecs[iVec].size;
+        }
+    }
+
+    /* Don't leave random data lying around on the stack. */
+    CRYPTORAND_ZERO_MEMORY(pBlock, sizeof(pBlock));
+
+    return result;
+}
+
+static void cryptorand_zero_iovecs(const cryptorand_iovec* pVecs, size_t count)
+{
+    size_t iVec;
+
+    for (iVec = 0; iVec < count; iVec += 1) {
+        if (pVecs[iVec].size > 0) {
+            CRYPTORAND_ZERO_MEMORY(pVecs[iVec].pData, pVecs[iVec].size);
+        }
+    }
+}
+
+CRYPTORAND_API cryptorand_result cryptorand_generate_v(cryptorand* pRNG, const cryptorand_iovec* pVecs, size_t count)
+{
+    cryptorand_result result;
+    cryptorand_uint64 byteCount = 0;
+    size_t iVec;
+
+    if (pRNG == NULL || (pVecs == NULL && count > 0)) {
+        return CRYPTORAND_INVALID_ARGS;
+    }
+
+    for (iVec = 0; iVec < count; iVec += 1) {
+        if (pVecs[iVec].pData == NULL && pVecs[iVec].size > 0) {
+            return CRYPTORAND_INVALID_ARGS;
+        }
+
+        byteCount += pVecs[iVec].size;
+    }
+
+    if (cryptorand_load_backend_vtable(pRNG) == NULL) {
+        result = cryptorand_init_lazy(pRNG);
+        if (result != CRYPTORAND_SUCCESS) {
+            cryptorand_zero_iovecs(pVecs, count);
+            return result;
+        }
+    }
+
+    CRYPTORAND_STATS_ADD(pRNG, generateCount, 1);
+
+    if (pRNG->health.failed) {
+        result = CRYPTORAND_HEALTH_FAILURE;
+    } else if (pRNG->buffer.capacity > 0) {
+        /* The buffer already batches up small requests so each one can just be read out of it. It's one hit only if the backend was never needed. */
+        cryptorand_bool32 isHit = CRYPTORAND_TRUE;
+
+        result = CRYPTORAND_SUCCESS;
+        for (iVec = 0; iVec < count && result == CRYPTORAND_SUCCESS; iVec += 1) {
+            if (pVecs[iVec].size > 0) {
+                cryptorand_bool32 isVecHit;
+                result = cryptorand_generate_buffered(pRNG, pVecs[iVec].pData, pVecs[iVec].size, &isVecHit);
+                isHit = isHit && isVecHit;
+            }
+        }
+
+        if (result == CRYPTORAND_SUCCESS && isHit) {
+            CRYPTORAND_STATS_ADD(pRNG, bufferHitCount, 1);
+        }
+    } else {
+        result = cryptorand_generate_v_unbuffered(pRNG, pVecs, count);
+    }
+
+    if (result != CRYPTORAND_SUCCESS) {
+        cryptorand_zero_iovecs(pVecs, count);
+        CRYPTORAND_STATS_ADD(pRNG, failureCount, 1);
+        CRYPTORAND_PROBE2(error, byteCount, (int)result);
+    } else {
+        CRYPTORAND_STATS_ADD(pRNG, bytesGenerated, byteCount);
+    }
+
+    return result;
+}
+
+CRYPTORAND_API cryptorand_result cryptorand_reseed(cryptorand* pRNG, const void* pAdditionalInput, size_t additionalInputSize)
+{
+    cryptorand_result result;
+    cryptorand* pBackendRNG;
+
+    if (pRNG == NULL || (pAdditionalInput == NULL && additionalInputSize > 0)) {
+        return CRYPTORAND_INVALID_ARGS;
+    }
+
+    if (cryptorand_load_backend_vtable(pRNG) == NULL) {
+        result = cryptorand_init_lazy(pRNG);
+        if (result != CRYPTORAND_SUCCESS) {
+            return result;
+        }
+    }
+
+    CRYPTORAND_STATS_ADD(pRNG, reseedCount, 1);
+    CRYPTORAND_PROBE2(reseed, additionalInputSize, 0);
+
+    /* Anything in the buffer was generated before the reseed so it needs to go. */
+    if (pRNG->buffer.capacity > 0) {
+        CRYPTORAND_ZERO_MEMORY(pRNG->buffer.pData, pRNG->buffer.capacity);
+        pRNG->buffer.cursor = pRNG->buffer.capacity;
+    }
+
+    pBackendRNG = (pRNG->pParent != NULL) ? pRNG->pParent : pRNG;
+    if (pBackendRNG->pBackendVTable->onReseed == NULL) {
+        return CRYPTORAND_SUCCESS;
+    }
+
+    return pBackendRNG->pBackendVTable->onReseed(pBackendRNG->pBackendUserData, pBackendRNG, pAdditionalInput, additionalInputSize);
+}
+
+CRYPTORAND_API cryptorand_result cryptorand_get_stats(const cryptorand* pRNG, cryptorand_stats* pStats)
+{
+    cryptorand_uint32 iBucket;
+
+    if (pStats == NULL) {
+        return CRYPTORAND_INVALID_ARGS;
+    }
+
+    CRYPTORAND_ZERO_OBJECT(pStats);
+
+    if (pRNG == NULL) {
+        return CRYPTORAND_INVALID_ARGS;
+    }
+
+    pStats->generateCount      = CRYPTORAND_STATS_LOAD(&pRNG->stats.generateCount);
+    pStats->bytesGenerated     = CRYPTORAND_STATS_LOAD(&pRNG->stats.bytesGenerated);
+    pStats->backendReadCount   = CRYPTORAND_STATS_LOAD(&pRNG->stats.backendReadCount);
+    pStats->backendBytesRead   = CRYPTORAND_STATS_LOAD(&pRNG->stats.backendBytesRead);
+    pStats->failureCount       = CRYPTORAND_STATS_LOAD(&pRNG->stats.failureCount);
+    pStats->healthFailureCount = CRYPTORAND_STATS_LOAD(&pRNG->stats.healthFailureCount);
+    pStats->bufferHitCount     = CRYPTORAND_STATS_LOAD(&pRNG->stats.bufferHitCount);
+    pStats->bufferRefillCount  = CRYPTORAND_STATS_LOAD(&pRNG->stats.bufferRefillCount);
+    pStats->reseedCount        = CRYPTORAND_STATS_LOAD(&pRNG->stats.reseedCount);
+
+    for (iBucket = 0; iBucket < CRYPTORAND_LATENCY_HISTOGRAM_SIZE; iBucket += 1) {
+        pStats->latencyHistogram[iBucket] = CRYPTORAND_STATS_LOAD(&pRNG->stats.latencyHistogram[iBucket]);
+    }
+
+    return CRYPTORAND_SUCCESS;
+}
+
+CRYPTORAND_API cryptorand_result cryptorand_generate_stream(cryptorand* pRNG, cryptorand_uint64 byteCount, cryptorand_stream_proc onData, void* pUserData)
+{
+    cryptorand_result result = CRYPTORAND_SUCCESS;
+    unsigned char pChunk[CRYPTORAND_STREAM_CHUNK_SIZE];
+
+    if (pRNG == NULL || onData == NULL) {
+        return CRYPTORAND_INVALID_ARGS;
+    }
+
+    /*
+    The data is generated in fixed sized chunks and handed straight to the callback. This way the
+    full output never needs to be resident in memory which is what you want when generating many
+    gigabytes of data.
+    */
+    while (byteCount > 0) {
+        size_t chunkSize = sizeof(pChunk);
+        if (chunkSize > byteCount) {
+            chunkSize = (size_t)byteCount;
+        }
+
+        result = cryptorand_generate(pRNG, pChunk, chunkSize);
+        if (result != CRYPTORAND_SUCCESS) {
+            break;
+        }
+
+        result = onData(pUserData, pChunk, chunkSize);
+        if (result != CRYPTORAND_SUCCESS) {
+            break;
+        }
+
+        byteCount -= chunkSize;
+    }
+
+    /* Don't leave random data lying around on the stack. */
+    CRYPTORAND_ZERO_MEMORY(pChunk, sizeof(pChunk));
+
+    return result;
+}
+
+
+/*
+Distributions. These are all built on top of a stream of 64-bit integers which are generated in
+blocks with cryptorand_generate() so that sampling doesn't need to go to the backend for every draw.
+*/
+#if !defined(CRYPTORAND_DISTRIBUTION_BLOCK_SIZE)
+    #define CRYPTORAND_DISTRIBUTION_BLOCK_SIZE  256 /* In 64-bit integers. This lives on the stack. */
+#endif
+
+typedef struct
+{
+    cryptorand* pRNG;
+    cryptorand_result result;   /* Set to the error code of the first failed refill. Sampling loops need to check this or else they may never end. */
+    size_t cursor;
+    cryptorand_uint64 block[CRYPTORAND_DISTRIBUTION_BLOCK_SIZE];
+} cryptorand_u64_stream;
+
+static void cryptorand_u64_stream_init(cryptorand* pRNG, cryptorand_u64_stream* pStream)
+{
+    pStream->pRNG   = pRNG;
+    pStream->result = CRYPTORAND_SUCCESS;
+    pStream->cursor = CRYPTORAND_DISTRIBUTION_BLOCK_SIZE;
+}
+
+static void cryptorand_u64_stream_uninit(cryptorand_u64_stream* pStream)
+{
+    CRYPTORAND_ZERO_MEMORY(pStream->block, sizeof(pStream->block));
+}
+
+static cryptorand_uint64 cryptorand_u64_stream_next(cryptorand_u64_stream* pStream)
+{
+    if (pStream->cursor == CRYPTORAND_DISTRIBUTION_BLOCK_SIZE) {
+        cryptorand_result result = cryptorand_generate(pStream->pRNG, pStream->block, sizeof(pStream->block));
+        if (result != CRYPTORAND_SUCCESS && pStream->result == CRYPTORAND_SUCCESS) {
+            pStream->result = result;
+        }
+
+        pStream->cursor = 0;
+    }
+
+    return pStream->block[pStream->cursor++];
+}
+
+/* Uniform in (0, 1]. Never returns 0 so it's safe to pass to cryptorand_log(). */
+static double cryptorand_u64_stream_next_f64_open0(cryptorand_u64_stream* pStream)
+{
+    return (double)((cryptorand_u64_stream_next(pStream) >> 11) + 1) * (1.0 / 9007199254740992.0);
+}
+
+
+/*
+Our own exp() and log() so we don't need to link to the math library. These only need to handle
+finite inputs in the ranges used by the samplers below, but they're accurate to within an ulp or two.
+*/
+#define CRYPTORAND_LN2_HI   6.93147180369123816490e-01
+#define CRYPTORAND_LN2_LO   1.90821492927058770002e-10
+
+static double cryptorand_exp(double x)
+{
+    /* 1/n! for n = 0..13. */
+    static const double c[14] =
+    {
+        1.0, 1.0, 1.0/2, 1.0/6, 1.0/24, 1.0/120, 1.0/720, 1.0/5040, 1.0/40320, 1.0/362880,
+        1.0/3628800, 1.0/39916800, 1.0/479001600, 1.0/6227020800.0
+    };
+    cryptorand_uint64 scaleBits;
+    double scale;
+    double r;
+    double p;
+    int k;
+    int n;
+
+    if (x < -708.0) {
+        return 0;
+    }
+    if (x > 709.0) {
+        x = 709.0;
+    }
+
+    /* x = k*ln(2) + r where |r| <= ln(2)/2. */
+    k = (int)(x * 1.4426950408889634 + ((x < 0) ? -0.5 : 0.5));
+    r = (x - k*CRYPTORAND_LN2_HI) - k*CRYPTORAND_LN2_LO;
+
+    p = c[13];
+    for (n = 12; n >= 0; n -= 1) {
+        p = p*r + c[n];
+    }
+
+    scaleBits = (cryptorand_uint64)(k + 1023) << 52;
+    CRYPTORAND_COPY_MEMORY(&scale, &scaleBits, sizeof(scale));
+
+    return p * scale;
+}
+
+static double cryptorand_log(double x)
+{
+    const cryptorand_uint64 mantissaMask = ((cryptorand_uint64)0x000FFFFF << 32) | 0xFFFFFFFF;
+    cryptorand_uint64 bits;
+    double m;
+    double s;
+    double s2;
+    double t;
+    int e = 0;
+
+    /* Only positive inputs are supported. */
+    if (x <= 0) {
+        return -1.0e308;
+    }
+
+    CRYPTORAND_COPY_MEMORY(&bits, &x, sizeof(bits));
+
+    if ((bits >> 52) == 0) {
+        /* Subnormal. Scale it up so we have a normalized mantissa to work with. */
+        x *= 18014398509481984.0;   /* 2^54 */
+        e  = -54;
+        CRYPTORAND_COPY_MEMORY(&bits, &x, sizeof(bits));
+    }
+
+    /* x = m * 2^e where m is in [sqrt(2)/2, sqrt(2)). */
+    e   += (int)((bits >> 52) & 0x7FF) - 1023;
+    bits = (bits & mantissaMask) | ((cryptorand_uint64)1023 << 52);
+    CRYPTORAND_COPY_MEMORY(&m, &bits, sizeof(m));
+
+    if (m > 1.4142135623730951) {
+        m *= 0.5;
+        e += 1;
+    }
+
+    /* log(m) = 2*atanh(s) = 2*(s + s^3/3 + s^5/5 + ...) where s = (m-1)/(m+1). */
+    s  = (m - 1) / (m + 1);
+    s2 = s*s;
+    t  = s2*(1.0/3 + s2*(1.0/5 + s2*(1.0/7 + s2*(1.0/9 + s2*(1.0/11 + s2*(1.0/13 + s2*(1.0/15 + s2*(1.0/17 + s2*(1.0/19 + s2*(1.0/21))))))))));
+
+    return e*CRYPTORAND_LN2_HI + (e*CRYPTORAND_LN2_LO + 2*s*(1 + t));
+}
+
+
+/*
+Ziggurat tables with 256 layers. Entry i is the right hand edge of layer i, with entry 0 being the
+width of the base layer's bounding rectangle (the base layer also includes the tail) and entry 256
+being 0. These were generated with the usual recurrence:
+
+    Normal:      R = 3.6541528853610088, V = 0.00492867323399,       x[i] = sqrt(-2*ln(V/x[i-1] + f(x[i-1])))
+    Exponential: R = 7.69711747013104972, V = 0.0039496598225815571993, x[i] = -ln(V/x[i-1] + f(x[i-1]))
+*/
+#define CRYPTORAND_ZIGGURAT_NORMAL_R        3.6541528853610088
+#define CRYPTORAND_ZIGGURAT_EXPONENTIAL_R   7.69711747013104972
+
+static const double cryptorand_g_ziggurat_normal_x[257] =
+{
+    3.91075795953709, 3.6541528853610088, 3.4492782985609645, 3.3202447338391661,
+    3.2245750520470291, 3.14788928951715, 3.083526132001233, 3.0278377917686354,
+    2.9786032798808448, 2.9343668672078542, 2.8941210536123481, 2.8571387308721325,
+    2.8228773968253251, 2.7909211740007858, 2.7609440052788226, 2.7326853590428271,
+    2.7059336561218581, 2.6805146432845222, 2.6562830375755024, 2.6331163936303246,
+    2.6109105184875485, 2.5895759867069952, 2.5690354526805366, 2.5492215503234608,
+    2.5300752321585169, 2.5115444416253423, 2.4935830412696807, 2.4761499396691433,
+    2.4592083743333113, 2.4427253181989568, 2.426670984935726, 2.4110184138996855,
+    2.3957431197804806, 2.380822795170626, 2.3662370567158186, 2.35196722737766,
+    2.3379961487950314, 2.324308018869623, 2.31088825059985, 2.2977233489013296,
+    2.2848008027229461, 2.2721089902268239, 2.2596370951722178, 2.2473750329458078,
+    2.235313384928328, 2.2234433400909057, 2.2117566428825444, 2.200245546609648,
+    2.1889027716247207, 2.1777214677386416, 2.166695180352646, 2.1558178198750633,
+    2.1450836340462036, 2.1344871828443202, 2.1240233156878157, 2.113687150684934,
+    2.1034740557131468, 2.0933796311370503, 2.0833996939965518, 2.0735302635169788,
+    2.0637675478099564, 2.0541079316488648, 2.0445479652157328, 2.0350843537278087,
+    2.025713947862033, 2.0164337349043717, 2.0072408305586849, 1.9981324713565642,
+    1.9891060076155713, 1.9801588968985984, 1.9712886979317696, 1.9624930649424619,
+    1.953769742382734, 1.9451165600067539, 1.9365314282737589, 1.9280123340507183,
+    1.9195573365912288, 1.9111645637692822, 1.9028322085484464, 1.8945585256687101,
+    1.8863418285347764, 1.8781804862909777, 1.8700729210692368, 1.8620176053976323,
+    1.8540130597581481, 1.8460578502831198, 1.8381505865807286, 1.8302899196806666,
+    1.8224745400917832, 1.8147031759641676, 1.8069745913486934, 1.7992875845475802,
+    1.79164098655001, 1.7840336595472763, 1.776464495522345, 1.7689324149090779,
+    1.7614363653167067, 1.7539753203154551, 1.746548278279493, 1.739154261283669,
+    1.7317923140507072, 1.7244615029457757, 1.7171609150155407, 1.7098896570690061,
+    1.7026468547976139, 1.6954316519322385, 1.6882432094348587, 1.6810807047228233,
+    1.6739433309237604, 1.6668302961592867, 1.6597408228557895, 1.6526741470806485,
+    1.6456295179023603, 1.6386061967731111, 1.631603456932422, 1.6246205828305684,
+    1.6176568695705342, 1.6107116223673337, 1.603784156023583, 1.5968737944202613,
+    1.5899798700216485, 1.5831017233934714, 1.5762387027333329, 1.5693901634125345,
+    1.5625554675284397, 1.5557339834665549, 1.5489250854715355, 1.5421281532263476,
+    1.5353425714388431, 1.5285677294350246, 1.5218030207582931, 1.5150478427739924,
+    1.508301596278572, 1.5015636851127065, 1.4948335157777184, 1.4881104970546544,
+    1.4813940396253757, 1.4746835556950255, 1.4679784586152309, 1.4612781625074078,
+    1.4545820818855233, 1.4478896312776697, 1.441200224845798, 1.4345132760029464,
+    1.4278281970272904, 1.4211443986723231, 1.4144612897724647, 1.4077782768433715,
+    1.4010947636762026, 1.3944101509250713, 1.3877238356868846, 1.381035211072742,
+    1.3743436657700305, 1.367648583594318, 1.3609493430301018, 1.3542453167594306,
+    1.3475358711773593, 1.3408203658931521, 1.3340981532160836, 1.3273685776246247,
+    1.3206309752177301, 1.313884673146869, 1.3071289890273539, 1.3003632303274337,
+    1.2935866937335176, 1.2867986644897864, 1.2799984157103332, 1.2731852076618437,
+    1.2663582870146883, 1.2595168860601442, 1.2526602218912979, 1.2457874955449979,
+    1.2388978911020274, 1.2319905747424451, 1.225064693752808, 1.2181193754817266,
+    1.2111537262399112, 1.2041668301405601, 1.1971577478755859, 1.1901255154228016,
+    1.1830691426787607, 1.1759876120114898, 1.1688798767268338, 1.1617448594415742,
+    1.1545814503558518, 1.1473885054167339, 1.1401648443639958, 1.132909248648337,
+    1.1256204592112944, 1.1182971741150629, 1.1109380460092495, 1.1035416794202682,
+    1.0961066278476035, 1.0886313906495142, 1.0811144096988894, 1.0735540657878717,
+    1.0659486747575067, 1.0582964833260065, 1.0505956645862071, 1.0428443131393705,
+    1.0350404398286053, 1.0271819660307513, 1.0192667174605292, 1.0112924174349784,
+    1.0032566795395914, 0.99515699962994308, 0.98699074709384627, 0.97875515528893775,
+    0.97044731105886461, 0.96206414321760525, 0.95360240987557265, 0.94505868446257113,
+    0.93642934028089686, 0.92771053339623477, 0.91889818364373499, 0.909987953490769,
+    0.90097522445517453, 0.89185507072679238, 0.88262222957891012, 0.87327106808249455,
+    0.86379554554682692, 0.85418917100156055, 0.84444495490242366, 0.83455535407951875,
+    0.82451220874528863, 0.81430667012806435, 0.80392911698266489, 0.79336905883315278,
+    0.78261502329958876, 0.77165442421673935, 0.76047340642208316, 0.74905666200958165,
+    0.73738721142583863, 0.72544614090130355, 0.71321228518202273, 0.70066184109758445,
+    0.68776789278625772, 0.67449982282743648, 0.66082257423420598, 0.64669571488438893,
+    0.63207223637502463, 0.61689698999623555, 0.60110461774394042, 0.58461676609372226,
+    0.56733825704047303, 0.54915170231302679, 0.52990972064649511, 0.50942332958593339,
+    0.48744396612175434, 0.46363433677176324, 0.43751840218666266, 0.40838913458800075,
+    0.37512133285046573, 0.33573751918045946, 0.28617459174726051, 0.21524189591327381,
+    0
+};
+
+static const double cryptorand_g_ziggurat_exponential_x[257] =
+{
+    8.6971174701310527, 7.6971174701310501, 6.9410336293772126, 6.4783784938325697,
+    6.1441646657724727, 5.8821443157953999, 5.6664101674540337, 5.4828906275260625,
+    5.323090505754398, 5.1814872813015, 5.0542884899813041, 4.9387770859012505,
+    4.832939741025112, 4.7352429966017411, 4.6444918854200852, 4.5597370617073514,
+    4.4802117465284219, 4.4052876934735732, 4.334443680317273, 4.2672424802773659,
+    4.2033137137351844, 4.1423408656640515, 4.0840513104082978, 4.0282085446479368,
+    3.9746060666737888, 3.9230625001354897, 3.8734176703995091, 3.8255294185223367,
+    3.7792709924116679, 3.7345288940397974, 3.6912010902374188, 3.6491955157608538,
+    3.6084288131289095, 3.568825265648337, 3.5303158891293434, 3.4928376547740596,
+    3.4563328211327602, 3.4207483572511199, 3.386035442460301, 3.3521490309001094,
+    3.319047470970748, 3.2866921715990687, 3.2550473085704499, 3.2240795652862642,
+    3.1937579032122403, 3.1640533580259729, 3.1349388580844404, 3.1063890623398245,
+    3.0783802152540902, 3.0508900166154551, 3.0238975044556766, 2.9973829495161306,
+    2.9713277599210897, 2.9457143948950457, 2.9205262865127408, 2.8957477686001418,
+    2.8713640120155364, 2.8473609656351888, 2.8237253024500353, 2.8004443702507378,
+    2.7775061464397566, 2.7548991965623446, 2.7326126361947001, 2.7106360958679288,
+    2.6889596887418037, 2.6675739807732666, 2.6464699631518092, 2.6256390267977885,
+    2.6050729387408356, 2.5847638202141408, 2.5647041263169053, 2.54488662711187,
+    2.525304390037828, 2.505950763528594, 2.4868193617402095, 2.4679040502973648,
+    2.4491989329782498, 2.4306983392644197, 2.4123968126888706, 2.3942890999214579,
+    2.3763701405361406, 2.3586350574093373, 2.3410791477030344, 2.3236978743901964,
+    2.3064868582835798, 2.2894418705322694, 2.2725588255531548, 2.2558337743672192,
+    2.239262898312909, 2.2228425031110368, 2.2065690132576639, 2.19043896672322,
+    2.1744490099377747, 2.158595893043886, 2.142876465399842, 2.1272876713173683,
+    2.1118265460190422, 2.096490211801715, 2.0812758743932251, 2.0661808194905755,
+    2.0512024094685848, 2.0363380802487696, 2.0215853383189262, 2.0069417578945186,
+    1.9924049782135766, 1.9779727009573604, 1.9636426877895483, 1.9494127580071849,
+    1.9352807862970514, 1.9212447005915281, 1.9073024800183875, 1.8934521529393082,
+    1.8796917950722112, 1.866019527692828, 1.8524335159111756, 1.83893196701888,
+    1.8255131289035198, 1.8121752885263906, 1.7989167704602909, 1.785735935484126,
+    1.7726311792313056, 1.7596009308890748, 1.7466436519460744, 1.7337578349855716,
+    1.7209420025219353, 1.7081947058780578, 1.6955145241015379, 1.6829000629175539,
+    1.6703499537164521, 1.6578628525741728, 1.6454374393037237, 1.6330724165359913,
+    1.6207665088282579, 1.6085184617988584, 1.5963270412864834, 1.5841910325326889,
+    1.5721092393862297, 1.5600804835278881, 1.5481036037145135, 1.5361774550410321,
+    1.5243009082192263, 1.5124728488721171, 1.5006921768428167, 1.4889578055167461,
+    1.4772686611561339, 1.4656236822457454, 1.4540218188487934, 1.4424620319720125,
+    1.4309432929388797, 1.4194645827699832, 1.4080248915695357, 1.3966232179170421,
+    1.385258568263122, 1.3739299563284906, 1.3626364025050868, 1.3513769332583352,
+    1.3401505805295046, 1.3289563811371166, 1.3177933761763247, 1.3066606104151741,
+    1.295557131686601, 1.2844819902750126, 1.2734342382962411, 1.2624129290696153,
+    1.2514171164808525, 1.2404458543344066, 1.2294981956938491, 1.2185731922087901,
+    1.2076698934267611, 1.1967873460884031, 1.1859245934042022, 1.1750806743109117,
+    1.1642546227056789, 1.1534454666557747, 1.1426522275816728, 1.1318739194110785,
+    1.1211095477013302, 1.110358108727411, 1.0996185885325973, 1.0888899619385468,
+    1.0781711915113723, 1.0674612264799677, 1.0567590016025514, 1.0460634359770442,
+    1.0353734317905285, 1.0246878730026172, 1.0140056239570965, 1.0033255279156967,
+    0.9926464055072759, 0.9819670530850626, 0.97128624098390326, 0.96060271166866651,
+    0.94991517776407597, 0.93922231995526229, 0.92852278474721039, 0.91781518207004431,
+    0.90709808271569026, 0.89637001558988993, 0.88562946476175153, 0.87487486629102507,
+    0.86410460481100448, 0.85331700984237335, 0.84251035181036849, 0.83168283773427321,
+    0.82083260655441181, 0.80995772405741828, 0.79905617735548717, 0.78812586886949243,
+    0.77716460975912971, 0.76617011273543467, 0.75513998418198225, 0.7440717155005081,
+    0.7329626735843654, 0.7218100903087562, 0.71061105090965504, 0.69936248110323196,
+    0.68806113277374781, 0.67670356802952258, 0.66528614139267794, 0.65380497984766495,
+    0.64225596042453637, 0.63063468493349029, 0.61893645139487607, 0.60715622162030003,
+    0.59528858429150289, 0.58332771274876949, 0.57126731653258833, 0.55910058551154063,
+    0.54682012516331058, 0.5344178812371656, 0.52188505159213505, 0.5092119824436544,
+    0.49638804551867116, 0.48340149165346186, 0.47023927508216901, 0.45688684093142024,
+    0.4433278660735524, 0.4295439402254107, 0.41551416960035636, 0.40121467889627777,
+    0.38661797794111957, 0.37169214532991723, 0.35639976025839382, 0.34069648106484912,
+    0.32452911701690945, 0.30783295467493216, 0.29052795549123039, 0.2725131854784647,
+    0.25365836338591202, 0.23379048305967473, 0.21267151063096662, 0.18995868962243184,
+    0.16512762256418728, 0.13730498094001259, 0.10483850756581878, 0.06385216381500157,
+    0
+};
+
+static double cryptorand_sample_normal(cryptorand_u64_stream* pStream)
+{
+    const double* x = cryptorand_g_ziggurat_normal_x;
+
+    for (;;) {
+        cryptorand_uint64 r = cryptorand_u64_stream_next(pStream);
+        unsigned int i = (unsigned int)(r & 0xFF);                          /* The low 8 bits select the layer... */
+        double u = (double)(r >> 11) * (1.0 / 4503599627370496.0) - 1.0;    /* ... and the top 53 bits are a uniform in [-1, 1). */
+        double z = u * x[i];
+        double f0;
+        double f1;
+
+        if (pStream->result != CRYPTORAND_SUCCESS) {
+            return 0;
+        }
+
+        /* The fast path. This is taken about 99% of the time. */
+        if (((z < 0) ? -z : z) < x[i+1]) {
+            return z;
+        }
+
+        if (i == 0) {
+            /* Tail. This is Marsaglia's method for sampling beyond R. */
+            double a;
+            double b;
+
+            do {
+                a = -cryptorand_log(cryptorand_u64_stream_next_f64_open0(pStream)) / CRYPTORAND_ZIGGURAT_NORMAL_R;
+                b = -cryptorand_log(cryptorand_u64_stream_next_f64_open0(pStream));
+
+                if (pStream->result != CRYPTORAND_SUCCESS) {
+                    return 0;
+                }
+            } while (b + b < a*a);
+
+            return (u < 0) ? -(CRYPTORAND_ZIGGURAT_NORMAL_R + a) : (CRYPTORAND_ZIGGURAT_NORMAL_R + a);
+        }
+
+        /* Wedge. */
+        f0 = cryptorand_exp(-0.5 * x[i]   * x[i]  );
+        f1 = cryptorand_exp(-0.5 * x[i+1] * x[i+1]);
+        if (f0 + cryptorand_u64_stream_next_f64_open0(pStream)*(f1 - f0) < cryptorand_exp(-0.5 * z * z)) {
+            return z;
+        }
+    }
+}
+
+static double cryptorand_sample_exponential(cryptorand_u64_stream* pStream)
+{
+    const double* x = cryptorand_g_ziggurat_exponential_x;
+
+    for (;;) {
+        cryptorand_uint64 r = cryptorand_u64_stream_next(pStream);
+        unsigned int i = (unsigned int)(r & 0xFF);
+        double u = (double)(r >> 11) * (1.0 / 9007199254740992.0);    /* [0, 1) */
+        double z = u * x[i];
+        double f0;
+        double f1;
+
+        if (pStream->result != CRYPTORAND_SUCCESS) {
+            return 0;
+        }
+
+        if (z < x[i+1]) {
+            return z;
+        }
+
+        if (i == 0) {
+            /* Tail. The exponential distribution is memoryless so this is just R plus another sample. */
+            return CRYPTORAND_ZIGGURAT_EXPONENTIAL_R - cryptorand_log(cryptorand_u64_stream_next_f64_open0(pStream));
+        }
+
+        /* Wedge. */
+        f0 = cryptorand_exp(-x[i]  );
+        f1 = cryptorand_exp(-x[i+1]);
+        if (f0 + cryptorand_u64_stream_next_f64_open0(pStream)*(f1 - f0) < cryptorand_exp(-z)) {
+            return z;
+        }
+    }
+}
+
+CRYPTORAND_API cryptorand_result cryptorand_normal_f64_array(cryptorand* pRNG, double* pOut, size_t count)
+{
+    cryptorand_u64_stream stream;
+    size_t i;
+
+    if (pRNG == NULL || pOut == NULL) {
+        return CRYPTORAND_INVALID_ARGS;
+    }
+
+    cryptorand_u64_stream_init(pRNG, &stream);
+
+    for (i = 0; i < count; i += 1) {
+        pOut[i] = cryptorand_sample_normal(&stream);
+        if (stream.result != CRYPTORAND_SUCCESS) {
+            CRYPTORAND_ZERO_MEMORY(pOut, sizeof(*pOut) * count);
+            break;
+        }
+    }
+
+    cryptorand_u64_stream_uninit(&stream);
+
+    return stream.result;
+}
+
+CRYPTORAND_API cryptorand_result cryptorand_exponential_f64_array(cryptorand* pRNG, double* pOut, size_t count)
+{
+    cryptorand_u64_stream stream;
+    size_t i;
+
+    if (pRNG == NULL || pOut == NULL) {
+        return CRYPTORAND_INVALID_ARGS;
+    }
+
+    cryptorand_u64_stream_init(pRNG, &stream);
+
+    for (i = 0; i < count; i += 1) {
+        pOut[i] = cryptorand_sample_exponential(&stream);
+        if (stream.result != CRYPTORAND_SUCCESS) {
+            CRYPTORAND_ZERO_MEMORY(pOut, sizeof(*pOut) * count);
+            break;
+        }
+    }
+
+    cryptorand_u64_stream_uninit(&stream);
+
+    return stream.result;
+}
+
+/*
+Alias tables. This is Vose's method, but done in 32.32 fixed point so the result doesn't depend on
+the floating point environment. While building, each entry temporarily holds the scaled weight of
+its column as a 64-bit integer until it's paired up. The small and large work lists share a single
+array in the scratch area, with small columns pushed from the front and large from the back.
+*/
+#define CRYPTORAND_ALIAS_ONE    ((cryptorand_uint64)1 << 32)
+
+static cryptorand_uint64 cryptorand_alias_entry_get_weight(const cryptorand_alias_entry* pEntry)
+{
+    cryptorand_uint64 weight;
+    CRYPTORAND_COPY_MEMORY(&weight, pEntry, sizeof(weight));
+    return weight;
+}
+
+static void cryptorand_alias_entry_set_weight(cryptorand_alias_entry* pEntry, cryptorand_uint64 weight)
+{
+    CRYPTORAND_COPY_MEMORY(pEntry, &weight, sizeof(weight));
+}
+
+CRYPTORAND_API cryptorand_result cryptorand_alias_table_get_heap_size(cryptorand_uint32 count, size_t* pHeapSizeInBytes)
+{
+    const size_t bytesPerColumn = sizeof(cryptorand_alias_entry) + sizeof(cryptorand_uint32);
+
+    if (pHeapSizeInBytes == NULL) {
+        return CRYPTORAND_INVALID_ARGS;
+    }
+
+    *pHeapSizeInBytes = 0;
+
+    if (count == 0) {
+        return CRYPTORAND_INVALID_ARGS;
+    }
+
+    if (count > CRYPTORAND_ALIAS_TABLE_MAX_COUNT || count > ((size_t)-1) / bytesPerColumn) {
+        return CRYPTORAND_TOO_BIG;
+    }
+
+    *pHeapSizeInBytes = (size_t)count * bytesPerColumn;
+
+    return CRYPTORAND_SUCCESS;
+}
+
+CRYPTORAND_API cryptorand_result cryptorand_alias_table_build_preallocated(const double* pWeights, cryptorand_uint32 count, void* pHeap, cryptorand_alias_table* pTable)
+{
+    cryptorand_result result;
+    size_t heapSizeInBytes;
+    cryptorand_alias_entry* pEntries;
+    cryptorand_uint32* pWork;
+    cryptorand_uint32 smallCount;
+    cryptorand_uint32 largeCount;
+    cryptorand_uint32 i;
+    double maxWeight;
+    double sum;
+    double scale;
+    double limit;
+
+    if (pTable == NULL) {
+        return CRYPTORAND_INVALID_ARGS;
+    }
+
+    CRYPTORAND_ZERO_OBJECT(pTable);
+
+    if (pWeights == NULL || pHeap == NULL) {
+        return CRYPTORAND_INVALID_ARGS;
+    }
+
+    result = cryptorand_alias_table_get_heap_size(count, &heapSizeInBytes);
+    if (result != CRYPTORAND_SUCCESS) {
+        return result;
+    }
+
+    /* Weights must be finite and non-negative, and at least one of them must be positive. */
+    maxWeight = 0;
+    for (i = 0; i < count; i += 1) {
+        if (!(pWeights[i] >= 0 && pWeights[i] <= 1.7976931348623157e308)) {
+            return CRYPTORAND_INVALID_ARGS;
+        }
+
+        if (pWeights[i] > maxWeight) {
+            maxWeight = pWeights[i];
+        }
+    }
+
+    if (!(maxWeight > 0)) {
+        return CRYPTORAND_INVALID_ARGS;
+    }
+
+    /*
+    The weights are divided by the largest one before summing. This keeps the sum between 1 and count
+    so it can't overflow with huge weights, and keeps the scale from overflowing with subnormal ones.
+    */
+    sum = 0;
+    for (i = 0; i < count; i += 1) {
+        sum += pWeights[i] / maxWeight;
+    }
+
+    pEntries = (cryptorand_alias_entry*)pHeap;
+    pWork    = (cryptorand_uint32*)(pEntries + count);
+
+    /*
+    Scale the weights so the average column has a weight of exactly one. No column can be heavier than
+    all of them together, which fits in 64 bits. The checks also reject NaN and infinity.
+    */
+    scale = ((double)count / sum) * (double)CRYPTORAND_ALIAS_ONE;
+    limit = (double)count * (double)CRYPTORAND_ALIAS_ONE;
+
+    if (!(scale > 0 && scale <= limit)) {
+        return CRYPTORAND_INVALID_ARGS;
+    }
+
+    smallCount = 0;
+    largeCount = 0;
+    for (i = 0; i < count; i += 1) {
+        double scaledWeight = (pWeights[i] / maxWeight) * scale;
+        cryptorand_uint64 weight;
+
+        if (!(scaledWeight >= 0 && scaledWeight <= limit)) {
+            return CRYPTORAND_INVALID_ARGS;
+        }
+
+        weight = (cryptorand_uint64)scaledWeight;
+        cryptorand_alias_entry_set_weight(&pEntries[i], weight);
+
+        if (weight < CRYPTORAND_ALIAS_ONE) {
+            pWork[smallCount] = i;
+            smallCount += 1;
+        } else {
+            largeCount += 1;
+            pWork[count - largeCount] = i;
+        }
+    }
+
+    /* Pair each small column with a large one, which donates the rest of the small column's space. */
+    while (smallCount > 0 && largeCount > 0) {
+        cryptorand_uint32 s = pWork[smallCount - 1];
+        cryptorand_uint32 l = pWork[count - largeCount];
+        cryptorand_uint64 smallWeight = cryptorand_alias_entry_get_weight(&pEntries[s]);
+        cryptorand_uint64 largeWeight = cryptorand_alias_entry_get_weight(&pEntries[l]);
+
+        pEntries[s].threshold = (cryptorand_uint32)smallWeight;
+        pEntries[s].alias     = l;
+
+        largeWeight -= CRYPTORAND_ALIAS_ONE - smallWeight;
+        cryptorand_alias_entry_set_weight(&pEntries[l], largeWeight);
+
+        if (largeWeight < CRYPTORAND_ALIAS_ONE) {
+            /* The large column is now small. It can take the place of the small column we just popped. */
+            largeCount -= 1;
+            pWork[smallCount - 1] = l;
+        } else {
+            smallCount -= 1;
+        }
+    }
+
+    /* Anything left over is within rounding error of a full column. These always select themselves. */
+    while (largeCount > 0) {
+        cryptorand_uint32 l = pWork[count - largeCount];
+        pEntries[l].threshold = 0xFFFFFFFF;
+        pEntries[l].alias     = l;
+        largeCount -= 1;
+    }
+
+    while (smallCount > 0) {
+        cryptorand_uint32 s = pWork[smallCount - 1];
+        pEntries[s].threshold = 0xFFFFFFFF;
+        pEntries[s].alias     = s;
+        smallCount -= 1;
+    }
+
+    CRYPTORAND_ZERO_MEMORY(pWork, sizeof(*pWork) * count);
+
+    pTable->pEntries = pEntries;
+    pTable->count    = count;
+    pTable->_pHeap   = pHeap;
+
+    return CRYPTORAND_SUCCESS;
+}
+
+CRYPTORAND_API cryptorand_result cryptorand_alias_table_build(const double* pWeights, cryptorand_uint32 count, const cryptorand_allocation_callbacks* pAllocationCallbacks, cryptorand_alias_table* pTable)
+{
+    cryptorand_result result;
+    size_t heapSizeInBytes;
+    void* pHeap;
+    cryptorand_allocation_callbacks allocationCallbacks;
+
+    if (pTable == NULL) {
+        return CRYPTORAND_INVALID_ARGS;
+    }
+
+    CRYPTORAND_ZERO_OBJECT(pTable);
+
+    result = cryptorand_alias_table_get_heap_size(count, &heapSizeInBytes);
+    if (result != CRYPTORAND_SUCCESS) {
+        return result;
+    }
+
+    result = cryptorand_allocation_callbacks_init_copy(&allocationCallbacks, pAllocationCallbacks);
+    if (result != CRYPTORAND_SUCCESS) {
+        return result;
+    }
+
+    pHeap = cryptorand_malloc(heapSizeInBytes, &allocationCallbacks);
+    if (pHeap == NULL) {
+        return CRYPTORAND_OUT_OF_MEMORY;
+    }
+
+    result = cryptorand_alias_table_build_preallocated(pWeights, count, pHeap, pTable);
+    if (result != CRYPTORAND_SUCCESS) {
+        cryptorand_free(pHeap, &allocationCallbacks);
+        return result;
+    }
+
+    pTable->allocationCallbacks = allocationCallbacks;
+    pTable->_ownsHeap = CRYPTORAND_TRUE;
+
+    return CRYPTORAND_SUCCESS;
+}
+
+CRYPTORAND_API void cryptorand_alias_table_uninit(cryptorand_alias_table* pTable)
+{
+    if (pTable == NULL) {
+        return;
+    }
+
+    if (pTable->_ownsHeap) {
+        cryptorand_free(pTable->_pHeap, &pTable->allocationCallbacks);
+    }
+
+    CRYPTORAND_ZERO_OBJECT(pTable);
+}
+
+CRYPTORAND_API cryptorand_result cryptorand_alias_sample_batch(cryptorand* pRNG, const cryptorand_alias_table* pTable, cryptorand_uint32* pIndices, size_t count)
+{
+    cryptorand_u64_stream stream;
+    cryptorand_uint32 columnCount;
+    cryptorand_uint32 rejectBelow;
+    size_t i;
+
+    if (pRNG == NULL || pTable == NULL || pTable->pEntries == NULL || pIndices == NULL) {
+        return CRYPTORAND_INVALID_ARGS;
+    }
+
+    columnCount = pTable->count;
+    rejectBelow = (0U - columnCount) % columnCount;   /* 2^32 mod columnCount. */
+
+    cryptorand_u64_stream_init(pRNG, &stream);
+
+    for (i = 0; i < count; i += 1) {
+        cryptorand_uint64 r;
+        cryptorand_uint64 m;
+        cryptorand_uint32 column;
+        cryptorand_alias_entry entry;
+
+        /*
+        The low 32 bits select the column with Lemire's multiply and shift, rejecting the few values
+        that would otherwise bias the result. The high 32 bits are compared against the threshold.
+        */
+        do {
+            r = cryptorand_u64_stream_next(&stream);
+            m = (r & 0xFFFFFFFF) * columnCount;
+        } while ((cryptorand_uint32)m < rejectBelow && stream.result == CRYPTORAND_SUCCESS);
+
+        if (stream.result != CRYPTORAND_SUCCESS) {
+            CRYPTORAND_ZERO_MEMORY(pIndices, sizeof(*pIndices) * count);
+            break;
+        }
+
+        column = (cryptorand_uint32)(m >> 32);
+        entry  = pTable->pEntries[column];
+
+        pIndices[i] = ((cryptorand_uint32)(r >> 32) < entry.threshold) ? column : entry.alias;
+    }
+
+    cryptorand_u64_stream_uninit(&stream);
+
+    return stream.result;
+}
+
+/* Permutations. */
+#define CRYPTORAND_PERMUTATION_BATCH_SIZE   8
+
+static cryptorand_uint64 cryptorand_permutation_round(cryptorand_uint64 half, cryptorand_uint64 key)
+{
+    /* This is the SplitMix64 finalizer applied to the half block mixed with the round key. */
+    cryptorand_uint64 x = ((half << 32) | half) ^ key;
+    x ^= x >> 31;
+    x *= ((cryptorand_uint64)0xBF58476D << 32) | 0x1CE4E5B9;
+    x ^= x >> 27;
+    x *= ((cryptorand_uint64)0x94D049BB << 32) | 0x133111EB;
+    x ^= x >> 31;
+    return x;
+}
+
+static cryptorand_uint64 cryptorand_permutation_encrypt(const cryptorand_permutation* pPermutation, cryptorand_uint64 x)
+{
+    cryptorand_uint64 l = x >> pPermutation->halfBits;
+    cryptorand_uint64 r = x &  pPermutation->halfMask;
+    cryptorand_uint32 iRound;
+
+    for (iRound = 0; iRound < CRYPTORAND_PERMUTATION_ROUNDS; iRound += 1) {
+        cryptorand_uint64 t = (l ^ cryptorand_permutation_round(r, pPermutation->keys[iRound])) & pPermutation->halfMask;
+        l = r;
+        r = t;
+    }
+
+    return (l << pPermutation->halfBits) | r;
+}
+
+static cryptorand_uint64 cryptorand_permutation_decrypt(const cryptorand_permutation* pPermutation, cryptorand_uint64 x)
+{
+    cryptorand_uint64 l = x >> pPermutation->halfBits;
+    cryptorand_uint64 r = x &  pPermutation->halfMask;
+    cryptorand_uint32 iRound;
+
+    for (iRound = CRYPTORAND_PERMUTATION_ROUNDS; iRound > 0; iRound -= 1) {
+        cryptorand_uint64 t = (r ^ cryptorand_permutation_round(l, pPermutation->keys[iRound - 1])) & pPermutation->halfMask;
+        r = l;
+        l = t;
+    }
+
+    return (l << pPermutation->halfBits) | r;
+}
+
+CRYPTORAND_API cryptorand_result cryptorand_permutation_init(cryptorand* pRNG, cryptorand_uint64 count, cryptorand_permutation* pPermutation)
+{
+    cryptorand_result result;
+    cryptorand_uint32 bits;
+
+    if (pPermutation == NULL) {
+        return CRYPTORAND_INVALID_ARGS;
+    }
+
+    CRYPTORAND_ZERO_OBJECT(pPermutation);
+
+    if (pRNG == NULL || count == 0) {
+        return CRYPTORAND_INVALID_ARGS;
+    }
+
+    /* The number of bits needed to represent count-1, rounded up to an even number of at least 2. */
+    bits = 0;
+    while (bits < 64 && ((count - 1) >> bits) != 0) {
+        bits += 1;
+    }
+
+    bits = (bits + 1) & ~1U;
+    if (bits == 0) {
+        bits = 2;
+    }
+
+    result = cryptorand_generate(pRNG, pPermutation->keys, sizeof(pPermutation->keys));
+    if (result != CRYPTORAND_SUCCESS) {
+        return result;
+    }
+
+    pPermutation->count    = count;
+    pPermutation->halfBits = bits / 2;
+    pPermutation->halfMask = ((cryptorand_uint64)1 << pPermutation->halfBits) - 1;
+
+    return CRYPTORAND_SUCCESS;
+}
+
+CRYPTORAND_API void cryptorand_permutation_uninit(cryptorand_permutation* pPermutation)
+{
+    if (pPermutation == NULL) {
+        return;
+    }
+
+    CRYPTORAND_ZERO_OBJECT(pPermutation);
+}
+
+CRYPTORAND_API cryptorand_uint64 cryptorand_permutation_permute(const cryptorand_permutation* pPermutation, cryptorand_uint64 index)
+{
+    if (pPermutation == NULL || index >= pPermutation->count) {
+        return index;
+    }
+
+    /*
+    Cycle walking. The Feistel network permutes the whole power of two domain, so keep going until we
+    land back in range. The domain is less than four times the size of the range so this terminates
+    quickly in practice.
+    */
+    do {
+        index = cryptorand_permutation_encrypt(pPermutation, index);
+    } while (index >= pPermutation->count);
+
+    return index;
+}
+
+CRYPTORAND_API cryptorand_uint64 cryptorand_permutation_inverse(const cryptorand_permutation* pPermutation, cryptorand_uint64 index)
+{
+    if (pPermutation == NULL || index >= pPermutation->count) {
+        return index;
+    }
+
+    do {
+        index = cryptorand_permutation_decrypt(pPermutation, index);
+    } while (index >= pPermutation->count);
+
+    return index;
+}
+
+CRYPTORAND_API void cryptorand_permutation_permute_batch(const cryptorand_permutation* pPermutation, const cryptorand_uint64* pIndicesIn, cryptorand_uint64* pIndicesOut, size_t count)
+{
+    size_t i = 0;
+
+    if (pPermutation == NULL || pIndicesIn == NULL || pIndicesOut == NULL) {
+        return;
+    }
+
+    /*
+    Indices are run through the network in groups with every round applied to each lane before moving
+    on to the next round. There are no dependencies between lanes which lets the compiler vectorize the
+    rounds. Only the rare lanes that need another cycle walking step fall back to the scalar path.
+    */
+    for (; i + CRYPTORAND_PERMUTATION_BATCH_SIZE <= count; i += CRYPTORAND_PERMUTATION_BATCH_SIZE) {
+        cryptorand_uint64 in[CRYPTORAND_PERMUTATION_BATCH_SIZE];
+        cryptorand_uint64 l[CRYPTORAND_PERMUTATION_BATCH_SIZE];
+        cryptorand_uint64 r[CRYPTORAND_PERMUTATION_BATCH_SIZE];
+        cryptorand_uint32 iRound;
+        cryptorand_uint32 iLane;
+
+        for (iLane = 0; iLane < CRYPTORAND_PERMUTATION_BATCH_SIZE; iLane += 1) {
+            in[iLane] = pIndicesIn[i + iLane];
+            l[iLane]  = in[iLane] >> pPermutation->halfBits;
+            r[iLane]  = in[iLane] &  pPermutation->halfMask;
+        }
+
+        for (iRound = 0; iRound < CRYPTORAND_PERMUTATION_ROUNDS; iRound += 1) {
+            for (iLane = 0; iLane < CRYPTORAND_PERMUTATION_BATCH_SIZE; iLane += 1) {
+                cryptorand_uint64 t = (l[iLane] ^ cryptorand_permutation_round(r[iLane], pPermutation->keys[iRound])) & pPermutation->halfMask;
+                l[iLane] = r[iLane];
+                r[iLane] = t;
+            }
+        }
+
+        for (iLane = 0; iLane < CRYPTORAND_PERMUTATION_BATCH_SIZE; iLane += 1) {
+            cryptorand_uint64 x = (l[iLane] << pPermutation->halfBits) | r[iLane];
+
+            if (in[iLane] >= pPermutation->count) {
+                x = in[iLane];
+            } else {
+                while (x >= pPermutation->count) {
+                    x = cryptorand_permutation_encrypt(pPermutation, x);
+                }
+            }
+
+            pIndicesOut[i + iLane] = x;
+        }
+    }
+
+    for (; i < count; i += 1) {
+        pIndicesOut[i] = cryptorand_permutation_permute(pPermutation, pIndicesIn[i]);
+    }
+}
+
+/*
+Big integers. Candidates are drawn in blocks so that bounds whose top byte only half fills its bit
+mask, like the Curve25519 group order, will almost always find an acceptable candidate with a single
+call into the generator.
+*/
+#if !defined(CRYPTORAND_BIGINT_BLOCK_SIZE)
+    #define CRYPTORAND_BIGINT_BLOCK_SIZE    256 /* This lives on the stack. */
+#endif
+
+#define CRYPTORAND_BIGINT_CANDIDATES_PER_BLOCK  4
+#define CRYPTORAND_BIGINT_MAX_ATTEMPTS          128  /* A correct backend will practically never get near this. It's here to stop a broken one from looping forever. */
+
+static const cryptorand_uint8 cryptorand_g_order_p256[32] =
+{
+    0xFF, 0xFF, 0xFF, 0xFF, 0x00, 0x00, 0x00, 0x00, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xBC, 0xE6, 0xFA, 0xAD, 0xA7, 0x17, 0x9E, 0x84, 0xF3, 0xB9, 0xCA, 0xC2, 0xFC, 0x63, 0x25, 0x51
+};
+
+static const cryptorand_uint8 cryptorand_g_order_secp256k1[32] =
+{
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFE,
+    0xBA, 0xAE, 0xDC, 0xE6, 0xAF, 0x48, 0xA0, 0x3B, 0xBF, 0xD2, 0x5E, 0x8C, 0xD0, 0x36, 0x41, 0x41
+};
+
+static const cryptorand_uint8 cryptorand_g_order_curve25519[32] =
+{
+    0x10, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x14, 0xDE, 0xF9, 0xDE, 0xA2, 0xF7, 0x9C, 0xD6, 0x58, 0x12, 0x63, 0x1A, 0x5C, 0xF5, 0xD3, 0xED
+};
+
+/* Returns 1 if a < b, 0 otherwise. Constant time. */
+static cryptorand_uint32 cryptorand_bigint_is_less(const cryptorand_uint8* a, const cryptorand_uint8* b, size_t len)
+{
+    cryptorand_uint32 borrow = 0;
+    size_t i = len;
+
+    while (i > 0) {
+        i -= 1;
+        borrow = ((cryptorand_uint32)a[i] - b[i] - borrow) >> 31;
+    }
+
+    return borrow;
+}
+
+/* Returns 1 if a is zero, 0 otherwise. Constant time. */
+static cryptorand_uint32 cryptorand_bigint_is_zero(const cryptorand_uint8* a, size_t len)
+{
+    cryptorand_uint32 bits = 0;
+    size_t i;
+
+    for (i = 0; i < len; i += 1) {
+        bits |= a[i];
+    }
+
+    return (bits - 1) >> 31;
+}
+
+static cryptorand_result cryptorand_bigint_below_ex(cryptorand* pRNG, const cryptorand_uint8* pBound, size_t len, cryptorand_bool32 excludeZero, cryptorand_uint8* pOut)
+{
+    cryptorand_result result = CRYPTORAND_ERROR;
+    cryptorand_uint8 block[CRYPTORAND_BIGINT_BLOCK_SIZE];
+    cryptorand_uint8* pCandidates;
+    cryptorand_uint32 candidateCount;
+    cryptorand_uint32 attempt;
+    cryptorand_uint8 mask;
+    size_t top;
+    size_t span;
+
+    if (pRNG == NULL || pBound == NULL || pOut == NULL || len == 0) {
+        return CRYPTORAND_INVALID_ARGS;
+    }
+
+    /* Leading zero bytes in the bound will be zero in the output. */
+    for (top = 0; top < len && pBound[top] == 0; top += 1) {
+    }
+
+    if (top == len || (excludeZero && top == len - 1 && pBound[top] == 1)) {
+        return CRYPTORAND_INVALID_ARGS;  /* The range is empty. */
+    }
+
+    span = len - top;
+
+    /* The smallest mask that covers the top byte of the bound. With this each candidate is accepted with a probability of at least 1/2. */
+    mask  = pBound[top];
+    mask |= mask >> 1;
+    mask |= mask >> 2;
+    mask |= mask >> 4;
+
+    /* When the top byte is all ones there's almost nothing to reject so it's not worth drawing more than one candidate. */
+    candidateCount = (pBound[top] == mask) ? 1 : CRYPTORAND_BIGINT_CANDIDATES_PER_BLOCK;
+    if (span * candidateCount > sizeof(block)) {
+        candidateCount = (cryptorand_uint32)(sizeof(block) / span);
+    }
+
+    /* When a single candidate won't fit in the block it's generated straight into the output buffer. */
+    pCandidates = (candidateCount > 0) ? block : pOut + top;
+    if (candidateCount == 0) {
+        candidateCount = 1;
+    }
+
+    CRYPTORAND_ZERO_MEMORY(pOut, top);
+
+    for (attempt = 0; attempt < CRYPTORAND_BIGINT_MAX_ATTEMPTS; attempt += 1) {
+        cryptorand_uint32 iCandidate;
+
+        result = cryptorand_generate(pRNG, pCandidates, span * candidateCount);
+        if (result != CRYPTORAND_SUCCESS) {
+            break;
+        }
+
+        for (iCandidate = 0; iCandidate < candidateCount; iCandidate += 1) {
+            cryptorand_uint8* pCandidate = pCandidates + (iCandidate * span);
+            cryptorand_uint32 accept;
+
+            pCandidate[0] &= mask;
+
+            accept = cryptorand_bigint_is_less(pCandidate, pBound + top, span);
+            if (excludeZero) {
+                accept &= cryptorand_bigint_is_zero(pCandidate, span) ^ 1;
+            }
+
+            if (accept) {
+                if (pCandidate != pOut + top) {
+                    CRYPTORAND_COPY_MEMORY(pOut + top, pCandidate, span);
+                }
+
+                CRYPTORAND_ZERO_MEMORY(block, sizeof(block));
+                return CRYPTORAND_SUCCESS;
+            }
+        }
+
+        result = CRYPTORAND_ERROR;
+    }
+
+    /* Don't leave rejected candidates lying around. */
+    CRYPTORAND_ZERO_MEMORY(block, sizeof(block));
+    CRYPTORAND_ZERO_MEMORY(pOut, len);
+
+    return result;
+}
+
+CRYPTORAND_API cryptorand_result cryptorand_bigint_below(cryptorand* pRNG, const cryptorand_uint8* pBound, size_t len, cryptorand_uint8* pOut)
+{
+    return cryptorand_bigint_below_ex(pRNG, pBound, len, CRYPTORAND_FALSE, pOut);
+}
+
+CRYPTORAND_API cryptorand_result cryptorand_scalar_p256(cryptorand* pRNG, cryptorand_uint8* pOut)
+{
+    return cryptorand_bigint_below_ex(pRNG, cryptorand_g_order_p256, sizeof(cryptorand_g_order_p256), CRYPTORAND_TRUE, pOut);
+}
+
+CRYPTORAND_API cryptorand_result cryptorand_scalar_secp256k1(cryptorand* pRNG, cryptorand_uint8* pOut)
+{
+    return cryptorand_bigint_below_ex(pRNG, cryptorand_g_order_secp256k1, sizeof(cryptorand_g_order_secp256k1), CRYPTORAND_TRUE, pOut);
+}
+
+CRYPTORAND_API cryptorand_result cryptorand_scalar_curve25519(cryptorand* pRNG, cryptorand_uint8* pOut)
+{
+    return cryptorand_bigint_below_ex(pRNG, cryptorand_g_order_curve25519, sizeof(cryptorand_g_order_curve25519), CRYPTORAND_TRUE, pOut);
+}
+
+/* Strings. */
+#if !defined(CRYPTORAND_STRING_BLOCK_SIZE)
+    #define CRYPTORAND_STRING_BLOCK_SIZE    256 /* This lives on the stack. */
+#endif
+
+CRYPTORAND_API cryptorand_result cryptorand_string(cryptorand* pRNG, const char* pAlphabet, size_t alphabetLen, char* pOut, size_t count)
+{
+    cryptorand_result result = CRYPTORAND_SUCCESS;
+    cryptorand_uint8 block[CRYPTORAND_STRING_BLOCK_SIZE];
+    cryptorand_uint32 symbolCount;
+    cryptorand_uint32 limit;
+    size_t written = 0;
+
+    if (pRNG == NULL || pAlphabet == NULL || pOut == NULL || alphabetLen == 0 || alphabetLen > 256) {
+        return CRYPTORAND_INVALID_ARGS;
+    }
+
+    /* Bytes at or above the largest multiple of the alphabet size that fits in a byte are rejected. */
+    symbolCount = (cryptorand_uint32)alphabetLen;
+    limit = 256 - (256 % symbolCount);
+
+    while (written < count) {
+        size_t remaining = count - written;
+        size_t bytesToGenerate;
+        size_t i;
+
+        /* Draw roughly as many bytes as we expect to need so that little is thrown away. */
+        bytesToGenerate = remaining + (remaining * (256 - limit)) / limit + 1;
+        if (bytesToGenerate > sizeof(block)) {
+            bytesToGenerate = sizeof(block);
+        }
+
+        result = cryptorand_generate(pRNG, block, bytesToGenerate);
+        if (result != CRYPTORAND_SUCCESS) {
+            CRYPTORAND_ZERO_MEMORY(pOut, count);
+            break;
+        }
+
+        /* The symbol is always written but only kept if the byte is accepted. This avoids a hard to predict branch per byte. */
+        for (i = 0; i < bytesToGenerate && written < count; i += 1) {
+            pOut[written] = pAlphabet[block[i] % symbolCount];
+            written += (block[i] < limit);
+        }
+    }
+
+    CRYPTORAND_ZERO_MEMORY(block, sizeof(block));
+
+    return result;
+}
+
+/* Uniform in [0, n) with Lemire's method. Only the low 32 bits of each draw are used. */
+static cryptorand_uint32 cryptorand_u64_stream_next_below(cryptorand_u64_stream* pStream, cryptorand_uint32 n)
 {
-    if (pRNG->win32.hAlgorithm != NULL) {
-        ((CRYPTORAND_PFN_BCryptCloseAlgorithmProvider)pRNG->win32.BCryptCloseAlgorithmProvider)(pRNG->win32.hAlgorithm, 0);
-    } else if (pRNG->win32.hProvider != NULL) {
-        ((CRYPTORAND_PFN_CryptReleaseContext)pRNG->win32.CryptReleaseContext)(pRNG->win32.hProvider, 0);
+    cryptorand_uint32 rejectBelow = (0U - n) % n;
+    cryptorand_uint64 m;
+
+    do {
+        m = (cryptorand_u64_stream_next(pStream) & 0xFFFFFFFF) * n;
+    } while ((cryptorand_uint32)m < rejectBelow && pStream->result == CRYPTORAND_SUCCESS);
+
+    return (cryptorand_uint32)(m >> 32);
+}
+
+CRYPTORAND_API cryptorand_result cryptorand_passphrase(cryptorand* pRNG, const char* const* ppWordList, size_t wordListCount, size_t wordCount, const char* pSeparator, char* pOut, size_t outCap, double* pEntropyBits)
+{
+    cryptorand_u64_stream stream;
+    size_t separatorLen;
+    size_t len = 0;
+    size_t iWord;
+
+    if (pEntropyBits != NULL) {
+        *pEntropyBits = 0;
     }
 
-    if (pRNG->win32.hBcryptDLL != NULL) {
-        FreeLibrary((HMODULE)pRNG->win32.hBcryptDLL);
+    if (pRNG == NULL || ppWordList == NULL || wordListCount == 0 || pOut == NULL || outCap == 0) {
+        return CRYPTORAND_INVALID_ARGS;
     }
-    if (pRNG->win32.hAdvapiDLL != NULL) {
-        FreeLibrary((HMODULE)pRNG->win32.hAdvapiDLL);
+
+    pOut[0] = '\0';
+
+    if ((cryptorand_uint64)wordListCount > 0xFFFFFFFF) {
+        return CRYPTORAND_TOO_BIG;
     }
-}
 
-static cryptorand_result cryptorand_generate__win32(cryptorand* pRNG, void* pBufferOut, size_t byteCount)
-{
-    if (byteCount > 0xFFFFFFFF) {
-        return CRYPTORAND_TOO_BIG;  /* TODO: Maybe handle this better by running in a loop. */
+    if (pSeparator == NULL) {
+        pSeparator = "";
     }
 
-    if (pRNG->win32.hAlgorithm != NULL) {
-        LONG result = ((CRYPTORAND_PFN_BCryptGenRandom)pRNG->win32.BCryptGenRandom)(pRNG->win32.hAlgorithm, (unsigned char*)pBufferOut, (ULONG)byteCount, 0);
-        if (result != 0) {
-            return CRYPTORAND_ERROR;
+    separatorLen = strlen(pSeparator);
+
+    cryptorand_u64_stream_init(pRNG, &stream);
+
+    for (iWord = 0; iWord < wordCount; iWord += 1) {
+        const char* pWord = ppWordList[cryptorand_u64_stream_next_below(&stream, (cryptorand_uint32)wordListCount)];
+        size_t wordLen;
+
+        if (stream.result != CRYPTORAND_SUCCESS) {
+            break;
         }
-    } else if (pRNG->win32.hProvider != NULL) {
-        if (!((CRYPTORAND_PFN_CryptGenRandom)pRNG->win32.CryptGenRandom)(pRNG->win32.hProvider, (DWORD)byteCount, (unsigned char*)pBufferOut)) {
-            return CRYPTORAND_ERROR;
+
+        if (pWord == NULL) {
+            stream.result = CRYPTORAND_INVALID_ARGS;
+            break;
+        }
+
+        wordLen = strlen(pWord);
+
+        if (iWord > 0) {
+            if (outCap - len <= separatorLen) {
+                stream.result = CRYPTORAND_TOO_BIG;
+                break;
+            }
+
+            CRYPTORAND_COPY_MEMORY(pOut + len, pSeparator, separatorLen);
+            len += separatorLen;
+        }
+
+        if (outCap - len <= wordLen) {
+            stream.result = CRYPTORAND_TOO_BIG;
+            break;
         }
+
+        CRYPTORAND_COPY_MEMORY(pOut + len, pWord, wordLen);
+        len += wordLen;
+    }
+
+    cryptorand_u64_stream_uninit(&stream);
+
+    if (stream.result != CRYPTORAND_SUCCESS) {
+        CRYPTORAND_ZERO_MEMORY(pOut, outCap);
+        return stream.result;
+    }
+
+    pOut[len] = '\0';
+
+    if (pEntropyBits != NULL) {
+        *pEntropyBits = (double)wordCount * (cryptorand_log((double)wordListCount) / (CRYPTORAND_LN2_HI + CRYPTORAND_LN2_LO));
     }
 
     return CRYPTORAND_SUCCESS;
 }
-#endif
 
-#if defined(CRYPTORAND_URANDOM)
-#include <stdio.h>
+/* Nonces. */
+static cryptorand_result cryptorand_nonce_generator_reprefix(cryptorand_nonce_generator* pGenerator)
+{
+    cryptorand_result result;
+
+    result = cryptorand_generate(pGenerator->pRNG, pGenerator->prefix, pGenerator->prefixSize);
+    if (result != CRYPTORAND_SUCCESS) {
+        return result;
+    }
 
-static cryptorand_result cryptorand_init__urandom(cryptorand* pRNG)
+    pGenerator->counter        = 0;
+    pGenerator->forkGeneration = cryptorand_get_fork_generation();
+
+    return CRYPTORAND_SUCCESS;
+}
+
+CRYPTORAND_API cryptorand_result cryptorand_nonce_generator_init(cryptorand* pRNG, size_t nonceSize, cryptorand_nonce_generator* pGenerator)
 {
-    pRNG->urandom.pFile = fopen("/dev/urandom", "rb");
-    if (pRNG->urandom.pFile == NULL) {
-        return CRYPTORAND_ERROR;
+    cryptorand_result result;
+
+    if (pGenerator == NULL) {
+        return CRYPTORAND_INVALID_ARGS;
+    }
+
+    CRYPTORAND_ZERO_OBJECT(pGenerator);
+
+    if (pRNG == NULL) {
+        return CRYPTORAND_INVALID_ARGS;
+    }
+
+    if (nonceSize == 12) {
+        pGenerator->prefixSize   = 8;
+        pGenerator->counterLimit = (cryptorand_uint64)1 << 32;
+    } else if (nonceSize == 24) {
+        pGenerator->prefixSize   = 16;
+        pGenerator->counterLimit = ~(cryptorand_uint64)0;  /* Not reachable in practice. */
+    } else {
+        return CRYPTORAND_INVALID_ARGS;
+    }
+
+    pGenerator->pRNG      = pRNG;
+    pGenerator->nonceSize = (cryptorand_uint32)nonceSize;
+
+    result = cryptorand_nonce_generator_reprefix(pGenerator);
+    if (result != CRYPTORAND_SUCCESS) {
+        CRYPTORAND_ZERO_OBJECT(pGenerator);
+        return result;
     }
 
     return CRYPTORAND_SUCCESS;
 }
 
-static void cryptorand_uninit__urandom(cryptorand* pRNG)
+CRYPTORAND_API void cryptorand_nonce_generator_uninit(cryptorand_nonce_generator* pGenerator)
 {
-    if (pRNG->urandom.pFile == NULL) {
+    if (pGenerator == NULL) {
         return;
     }
 
-    fclose((FILE*)pRNG->urandom.pFile);
+    CRYPTORAND_ZERO_OBJECT(pGenerator);
 }
 
-static cryptorand_result cryptorand_generate__urandom(cryptorand* pRNG, void* pBufferOut, size_t byteCount)
+CRYPTORAND_API cryptorand_result cryptorand_nonce_generator_next(cryptorand_nonce_generator* pGenerator, void* pNonceOut)
 {
-    size_t bytesRead;
+    cryptorand_uint8* pNonce = (cryptorand_uint8*)pNonceOut;
+    cryptorand_uint64 counter;
+    cryptorand_uint32 i;
 
-    if (pRNG->urandom.pFile == NULL) {
-        return CRYPTORAND_INVALID_OPERATION;
+    if (pGenerator == NULL || pGenerator->pRNG == NULL || pNonceOut == NULL) {
+        return CRYPTORAND_INVALID_ARGS;
+    }
+
+    /* A forked child would otherwise emit the same nonces as the parent. */
+    if (pGenerator->counter == pGenerator->counterLimit || pGenerator->forkGeneration != cryptorand_get_fork_generation()) {
+        cryptorand_result result = cryptorand_nonce_generator_reprefix(pGenerator);
+        if (result != CRYPTORAND_SUCCESS) {
+            CRYPTORAND_ZERO_MEMORY(pNonceOut, pGenerator->nonceSize);
+            return result;
+        }
     }
 
-    bytesRead = fread(pBufferOut, 1, byteCount, (FILE*)pRNG->urandom.pFile);
-    if (bytesRead < byteCount) {
-        return CRYPTORAND_ERROR;    /* Wasn't able to read all the data. Should never happen. */
+    counter = pGenerator->counter;
+
+    CRYPTORAND_COPY_MEMORY(pNonce, pGenerator->prefix, pGenerator->prefixSize);
+    for (i = pGenerator->nonceSize; i > pGenerator->prefixSize; i -= 1) {
+        pNonce[i - 1] = (cryptorand_uint8)(counter & 0xFF);
+        counter >>= 8;
     }
 
+    pGenerator->counter += 1;
+
     return CRYPTORAND_SUCCESS;
 }
+
+/*
+Readiness. On Linux, getrandom() with GRND_NONBLOCK fails with EAGAIN until the pool has been seeded,
+which is exactly what we want. On kernels without getrandom(), and on other POSIX platforms, we poll
+/dev/random which becomes readable once the generator is seeded.
+*/
+#if defined(CRYPTORAND_POSIX)
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <errno.h>
+#if defined(__linux__)
+#include <sys/syscall.h>
 #endif
 
-#if defined(CRYPTORAND_ARC4RANDOM)
-#include <stdlib.h>
+#if !defined(CRYPTORAND_O_CLOEXEC)
+    #if defined(O_CLOEXEC)
+        #define CRYPTORAND_O_CLOEXEC    O_CLOEXEC
+    #else
+        #define CRYPTORAND_O_CLOEXEC    0
+    #endif
+#endif
 
-static cryptorand_result cryptorand_init__arc4random(cryptorand* pRNG)
+#define CRYPTORAND_GRND_NONBLOCK    0x0001
+
+CRYPTORAND_API cryptorand_result cryptorand_open_ready_fd(int* pFD)
 {
-    (void)pRNG;
+    int fd;
+
+    if (pFD == NULL) {
+        return CRYPTORAND_INVALID_ARGS;
+    }
+
+    fd = open("/dev/random", O_RDONLY | O_NONBLOCK | CRYPTORAND_O_CLOEXEC);
+    if (fd < 0) {
+        *pFD = -1;
+        return (errno == EACCES) ? CRYPTORAND_ACCESS_DENIED : CRYPTORAND_IO_ERROR;
+    }
+
+    *pFD = fd;
+
     return CRYPTORAND_SUCCESS;
 }
 
-static void cryptorand_uninit__arc4random(cryptorand* pRNG)
+static cryptorand_result cryptorand_poll_ready__posix(int timeoutInMilliseconds)
 {
-    (void)pRNG;
+    cryptorand_result result;
+    struct pollfd pfd;
+    int fd;
+    int pollResult;
+
+    result = cryptorand_open_ready_fd(&fd);
+    if (result != CRYPTORAND_SUCCESS) {
+        return result;
+    }
+
+    pfd.fd      = fd;
+    pfd.events  = POLLIN;
+    pfd.revents = 0;
+
+    do {
+        pollResult = poll(&pfd, 1, timeoutInMilliseconds);
+    } while (pollResult < 0 && errno == EINTR);
+
+    close(fd);
+
+    if (pollResult > 0) {
+        return CRYPTORAND_SUCCESS;
+    } else if (pollResult == 0) {
+        return CRYPTORAND_TIMEOUT;
+    } else {
+        return CRYPTORAND_IO_ERROR;
+    }
 }
+#endif
 
-static cryptorand_result cryptorand_generate__arc4random(cryptorand* pRNG, void* pBufferOut, size_t byteCount)
+/*
+Returns CRYPTORAND_SUCCESS if the generator is ready, CRYPTORAND_TIMEOUT if it's still not ready
+after the timeout, or an error if we couldn't find out.
+*/
+static cryptorand_result cryptorand_check_ready(int timeoutInMilliseconds)
 {
-    /* The arc4random() family is always successful. */
-    arc4random_buf(pBufferOut, byteCount);
+#if defined(CRYPTORAND_POSIX)
+#if defined(__linux__) && defined(SYS_getrandom)
+    {
+        unsigned char value;
+        long result;
 
-    (void)pRNG;
+        do {
+            result = syscall(SYS_getrandom, &value, 1, CRYPTORAND_GRND_NONBLOCK);
+        } while (result < 0 && errno == EINTR);
+
+        value = 0;
+
+        if (result == 1) {
+            return CRYPTORAND_SUCCESS;
+        }
+
+        if (result < 0 && errno == EAGAIN && timeoutInMilliseconds == 0) {
+            return CRYPTORAND_TIMEOUT;
+        }
+
+        /* Either getrandom() isn't available or we need to wait. Fall back to polling. */
+    }
+#endif
+
+    return cryptorand_poll_ready__posix(timeoutInMilliseconds);
+#else
+    (void)timeoutInMilliseconds;
     return CRYPTORAND_SUCCESS;
-}
 #endif
+}
 
+CRYPTORAND_API cryptorand_bool32 cryptorand_is_ready(void)
+{
+    return cryptorand_check_ready(0) == CRYPTORAND_SUCCESS;
+}
 
-CRYPTORAND_API cryptorand_result cryptorand_init(cryptorand* pRNG)
+CRYPTORAND_API cryptorand_result cryptorand_wait_ready(cryptorand_uint32 timeoutInMilliseconds)
 {
-    cryptorand_result result;
+    return cryptorand_check_ready((timeoutInMilliseconds > 0x7FFFFFFF) ? -1 : (int)timeoutInMilliseconds);
+}
 
-    if (pRNG == NULL) {
+
+#if defined(CRYPTORAND_POSIX)
+#include <unistd.h>
+#include <errno.h>
+
+static cryptorand_result cryptorand_write_all__posix(int fd, const unsigned char* pData, size_t dataSize)
+{
+    while (dataSize > 0) {
+        ssize_t bytesWritten = write(fd, pData, dataSize);
+        if (bytesWritten < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            return CRYPTORAND_IO_ERROR;
+        }
+
+        if (bytesWritten == 0) {
+            return CRYPTORAND_IO_ERROR; /* Should never happen with a blocking descriptor, but don't want to get stuck in an infinite loop. */
+        }
+
+        pData    += bytesWritten;
+        dataSize -= (size_t)bytesWritten;
+    }
+
+    return CRYPTORAND_SUCCESS;
+}
+
+CRYPTORAND_API cryptorand_result cryptorand_write_fd(cryptorand* pRNG, int fd, cryptorand_uint64 byteCount)
+{
+    cryptorand_result result = CRYPTORAND_SUCCESS;
+    unsigned char pChunkUnaligned[CRYPTORAND_WRITE_CHUNK_SIZE + CRYPTORAND_WRITE_ALIGNMENT];
+    unsigned char* pChunk;
+
+    if (pRNG == NULL || fd < 0) {
         return CRYPTORAND_INVALID_ARGS;
     }
 
-    CRYPTORAND_ZERO_OBJECT(pRNG);
+    /*
+    The chunk is aligned so that descriptors opened with O_DIRECT can be written to directly. In this
+    case the byte count needs to be a multiple of the device's block size or else the last write will
+    fail, but that's up to the caller.
+    */
+    pChunk = (unsigned char*)(((size_t)pChunkUnaligned + (CRYPTORAND_WRITE_ALIGNMENT - 1)) & ~(size_t)(CRYPTORAND_WRITE_ALIGNMENT - 1));
 
-#if defined(CRYPTORAND_WIN32)
-    result = cryptorand_init__win32(pRNG);
-#elif defined(CRYPTORAND_URANDOM)
-    result = cryptorand_init__urandom(pRNG);
-#elif defined(CRYPTORAND_ARC4RANDOM)
-    result = cryptorand_init__arc4random(pRNG);
-#else
-    result = CRYPTORAND_NOT_IMPLEMENTED;
-#endif
+    while (byteCount > 0) {
+        size_t chunkSize = CRYPTORAND_WRITE_CHUNK_SIZE;
+        if (chunkSize > byteCount) {
+            chunkSize = (size_t)byteCount;
+        }
 
-    if (result != CRYPTORAND_SUCCESS) {
-        CRYPTORAND_ZERO_OBJECT(pRNG);   /* Make sure the caller is given a blank object on failure. */
+        result = cryptorand_generate(pRNG, pChunk, chunkSize);
+        if (result != CRYPTORAND_SUCCESS) {
+            break;
+        }
+
+        result = cryptorand_write_all__posix(fd, pChunk, chunkSize);
+        if (result != CRYPTORAND_SUCCESS) {
+            break;
+        }
+
+        byteCount -= chunkSize;
     }
 
+    CRYPTORAND_ZERO_MEMORY(pChunkUnaligned, sizeof(pChunkUnaligned));
+
     return result;
 }
+#endif
 
-CRYPTORAND_API void cryptorand_uninit(cryptorand* pRNG)
-{
-    if (pRNG == NULL) {
-        return;
-    }
+#if defined(CRYPTORAND_POSIX)
+#include <sys/mman.h>
 
-#if defined(CRYPTORAND_WIN32)
-    cryptorand_uninit__win32(pRNG);
-#elif defined(CRYPTORAND_URANDOM)
-    cryptorand_uninit__urandom(pRNG);
-#elif defined(CRYPTORAND_ARC4RANDOM)
-    cryptorand_uninit__arc4random(pRNG);
-#else
-    /* Not implemented. */
+#if !defined(MAP_ANONYMOUS) && defined(MAP_ANON)
+    #define MAP_ANONYMOUS MAP_ANON
 #endif
 
-    CRYPTORAND_ZERO_OBJECT(pRNG);
+static size_t cryptorand_align_up(size_t value, size_t alignment)
+{
+    return (value + (alignment - 1)) & ~(alignment - 1);
 }
 
-CRYPTORAND_API cryptorand_result cryptorand_generate(cryptorand* pRNG, void* pBufferOut, size_t byteCount)
+CRYPTORAND_API cryptorand_result cryptorand_secure_pool_init(size_t slotSizeInBytes, cryptorand_uint32 slotCount, cryptorand_secure_pool* pPool)
 {
-    cryptorand_result result;
+    size_t pageSize;
+    size_t metadataSizeInBytes;
+    size_t slotsSizeInBytes;
+    cryptorand_uint8* pMapping;
+    cryptorand_uint32 iSlot;
 
-    if (pRNG == NULL || pBufferOut == NULL) {
+    if (pPool == NULL) {
         return CRYPTORAND_INVALID_ARGS;
     }
 
-#if defined(CRYPTORAND_WIN32)
-    result = cryptorand_generate__win32(pRNG, pBufferOut, byteCount);
-#elif defined(CRYPTORAND_URANDOM)
-    result = cryptorand_generate__urandom(pRNG, pBufferOut, byteCount);
-#elif defined(CRYPTORAND_ARC4RANDOM)
-    result = cryptorand_generate__arc4random(pRNG, pBufferOut, byteCount);
-#else
-    result = CRYPTORAND_NOT_IMPLEMENTED;
-#endif
+    CRYPTORAND_ZERO_OBJECT(pPool);
+
+    if (slotSizeInBytes == 0 || slotCount == 0) {
+        return CRYPTORAND_INVALID_ARGS;
+    }
+
+    pageSize = (size_t)sysconf(_SC_PAGESIZE);
+    if (pageSize == 0 || (pageSize & (pageSize - 1)) != 0) {
+        pageSize = 4096;
+    }
+
+    slotSizeInBytes = cryptorand_align_up(slotSizeInBytes, CRYPTORAND_SECURE_POOL_ALIGNMENT);
+    if (slotSizeInBytes == 0 || slotCount > ((size_t)-1 - pageSize*4) / slotSizeInBytes) {
+        return CRYPTORAND_TOO_BIG;
+    }
 
     /*
-    If an error occurred, make sure everything is cleared to zero to make it clear to the caller that
-    the content in the buffer is not valid.
+    The layout is [guard][metadata][guard][slots][guard]. The metadata is the free list and is kept
+    away from the slots because the slots are wiped on fork, and we still want the pool to be usable
+    in the child.
     */
-    if (result != CRYPTORAND_SUCCESS) {
-        CRYPTORAND_ZERO_MEMORY(pBufferOut, byteCount);
+    metadataSizeInBytes = cryptorand_align_up(sizeof(cryptorand_uint32) * slotCount, pageSize);
+    slotsSizeInBytes    = cryptorand_align_up(slotSizeInBytes * slotCount, pageSize);
+
+    pPool->mappingSizeInBytes = pageSize + metadataSizeInBytes + pageSize + slotsSizeInBytes + pageSize;
+
+    pMapping = (cryptorand_uint8*)mmap(NULL, pPool->mappingSizeInBytes, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (pMapping == (cryptorand_uint8*)MAP_FAILED) {
+        CRYPTORAND_ZERO_OBJECT(pPool);
+        return CRYPTORAND_OUT_OF_MEMORY;
     }
 
-    return result;
+    pPool->pMapping        = pMapping;
+    pPool->pNextFree       = (cryptorand_uint32*)(pMapping + pageSize);
+    pPool->pSlots          = pMapping + pageSize + metadataSizeInBytes + pageSize;
+    pPool->slotSizeInBytes = slotSizeInBytes;
+    pPool->slotCount       = slotCount;
+
+    /* Everything other than the guard pages needs to be accessible. */
+    if (mprotect(pPool->pNextFree, metadataSizeInBytes, PROT_READ | PROT_WRITE) != 0 ||
+        mprotect(pPool->pSlots,    slotsSizeInBytes,    PROT_READ | PROT_WRITE) != 0) {
+        /* Can't go through cryptorand_secure_pool_uninit() because the slots might not be writable. There's nothing to wipe yet anyway. */
+        munmap(pMapping, pPool->mappingSizeInBytes);
+        CRYPTORAND_ZERO_OBJECT(pPool);
+        return CRYPTORAND_ERROR;
+    }
+
+    /* This is the part that'll fail if RLIMIT_MEMLOCK is too small. */
+    if (mlock(pPool->pSlots, slotsSizeInBytes) != 0) {
+        cryptorand_result result = (errno == EPERM) ? CRYPTORAND_ACCESS_DENIED : CRYPTORAND_OUT_OF_MEMORY;
+        cryptorand_secure_pool_uninit(pPool);
+        return result;
+    }
+
+    /* These are best effort. Not all kernels support them. */
+    #if defined(MADV_DONTDUMP)
+    {
+        madvise(pPool->pSlots, slotsSizeInBytes, MADV_DONTDUMP);
+    }
+    #endif
+    #if defined(MADV_WIPEONFORK)
+    {
+        madvise(pPool->pSlots, slotsSizeInBytes, MADV_WIPEONFORK);
+    }
+    #endif
+
+    /* All slots start off free. */
+    for (iSlot = 0; iSlot < slotCount; iSlot += 1) {
+        pPool->pNextFree[iSlot] = iSlot + 1;
+    }
+    pPool->freeHead = 0;
+
+    return CRYPTORAND_SUCCESS;
+}
+
+CRYPTORAND_API void cryptorand_secure_pool_uninit(cryptorand_secure_pool* pPool)
+{
+    if (pPool == NULL || pPool->pMapping == NULL) {
+        return;
+    }
+
+    /* Don't trust the application to have freed everything. Wipe it all before returning the pages. */
+    CRYPTORAND_ZERO_MEMORY(pPool->pSlots, (size_t)pPool->slotSizeInBytes * pPool->slotCount);
+
+    munmap(pPool->pMapping, pPool->mappingSizeInBytes);
+    CRYPTORAND_ZERO_OBJECT(pPool);
+}
+
+CRYPTORAND_API void* cryptorand_secure_pool_alloc(cryptorand_secure_pool* pPool, size_t sizeInBytes)
+{
+    cryptorand_uint32 iSlot;
+
+    if (pPool == NULL || pPool->pMapping == NULL || sizeInBytes > pPool->slotSizeInBytes) {
+        return NULL;
+    }
+
+    if (pPool->freeHead == pPool->slotCount) {
+        return NULL;    /* Out of slots. */
+    }
+
+    iSlot = pPool->freeHead;
+    pPool->freeHead = pPool->pNextFree[iSlot];
+    pPool->pNextFree[iSlot] = pPool->slotCount;
+
+    return pPool->pSlots + (iSlot * pPool->slotSizeInBytes);
+}
+
+CRYPTORAND_API void cryptorand_secure_pool_free(cryptorand_secure_pool* pPool, void* p)
+{
+    size_t offset;
+    cryptorand_uint32 iSlot;
+
+    if (pPool == NULL || pPool->pMapping == NULL || p == NULL) {
+        return;
+    }
+
+    if ((cryptorand_uint8*)p < pPool->pSlots) {
+        return; /* Not from this pool. */
+    }
+
+    offset = (size_t)((cryptorand_uint8*)p - pPool->pSlots);
+    if (offset % pPool->slotSizeInBytes != 0 || offset / pPool->slotSizeInBytes >= pPool->slotCount) {
+        return; /* Not from this pool. */
+    }
+
+    iSlot = (cryptorand_uint32)(offset / pPool->slotSizeInBytes);
+
+    CRYPTORAND_ZERO_MEMORY(p, pPool->slotSizeInBytes);
+
+    pPool->pNextFree[iSlot] = pPool->freeHead;
+    pPool->freeHead = iSlot;
+}
+
+static void* cryptorand_secure_pool__on_malloc(size_t sz, void* pUserData)
+{
+    return cryptorand_secure_pool_alloc((cryptorand_secure_pool*)pUserData, sz);
+}
+
+static void* cryptorand_secure_pool__on_realloc(void* p, size_t sz, void* pUserData)
+{
+    /* Slots are fixed size so there's nothing to move. */
+    if (p != NULL && sz <= ((cryptorand_secure_pool*)pUserData)->slotSizeInBytes) {
+        return p;
+    }
+
+    return NULL;
+}
+
+static void cryptorand_secure_pool__on_free(void* p, void* pUserData)
+{
+    cryptorand_secure_pool_free((cryptorand_secure_pool*)pUserData, p);
+}
+
+CRYPTORAND_API cryptorand_allocation_callbacks cryptorand_secure_pool_get_allocation_callbacks(cryptorand_secure_pool* pPool)
+{
+    cryptorand_allocation_callbacks callbacks;
+
+    callbacks.pUserData = pPool;
+    callbacks.onMalloc  = cryptorand_secure_pool__on_malloc;
+    callbacks.onRealloc = cryptorand_secure_pool__on_realloc;
+    callbacks.onFree    = cryptorand_secure_pool__on_free;
+
+    return callbacks;
 }
+#endif
 
 #endif  /* cryptorand_c */
 #endif  /* CRYPTORAND_IMPLEMENTATION */
@@ -0,0 +1,154 @@
+/*
+Rough benchmarks. These are not part of the test suite. Compile with optimizations:
+
+    g++ -O2 -std=c++11 tests/cryptorand_bench.cpp -o cryptorand_bench
+*/
+#define CRYPTORAND_IMPLEMENTATION
+#define CRYPTORAND_INLINE_FASTPATH
+#include "../cryptorand.h"
+
+#include <chrono>
+#include <random>
+#include <cstdio>
+
+template <typename Func>
+static void bench(const char* pName, size_t iterations, Func func)
+{
+    auto start = std::chrono::steady_clock::now();
+    cryptorand_uint64 sink = 0;
+
+    for (size_t i = 0; i < iterations; i += 1) {
+        sink ^= func();
+    }
+
+    auto end = std::chrono::steady_clock::now();
+    double ns = std::chrono::duration<double, std::nano>(end - start).count() / iterations;
+
+    printf("%-40s %8.2f ns/call (%llx)\n", pName, ns, (unsigned long long)(sink & 0xF));
+}
+
+int main()
+{
+    const size_t iterations = 1000000;
+    cryptorand rng;
+    cryptorand_init(&rng);
+
+    bench("cryptorand_generate() 8 bytes", iterations, [&]() {
+        cryptorand_uint64 value;
+        cryptorand_generate(&rng, &value, sizeof(value));
+        return value;
+    });
+
+    {
+        cryptorand_cpp::engine engine;
+        bench("cryptorand_cpp::engine", iterations, [&]() {
+            return engine();
+        });
+    }
+
+    bench("cryptorand_generate() 16 bytes", iterations, [&]() {
+        unsigned char id[16];
+        cryptorand_generate(&rng, id, sizeof(id));
+        return (cryptorand_uint64)id[0];
+    });
+
+#if defined(CRYPTORAND_URANDOM)
+    {
+        /* The stock backends are tried in order so force /dev/urandom by passing it in as a custom backend. */
+        const cryptorand_backend_vtable* const pBackendVTables[] = {&cryptorand_g_backend_vtable_urandom};
+        cryptorand urandom;
+        cryptorand_config config = cryptorand_config_init();
+        config.ppCustomBackendVTables = pBackendVTables;
+        config.customBackendCount     = 1;
+        cryptorand_init_ex(&config, &urandom);
+
+        bench("cryptorand_generate() 16 bytes, urandom", iterations, [&]() {
+            unsigned char id[16];
+            cryptorand_generate(&urandom, id, sizeof(id));
+            return (cryptorand_uint64)id[0];
+        });
+
+        bench("cryptorand_generate() x3, urandom", iterations, [&]() {
+            unsigned char salt[16], iv[12], key[32];
+            cryptorand_generate(&urandom, salt, sizeof(salt));
+            cryptorand_generate(&urandom, iv, sizeof(iv));
+            cryptorand_generate(&urandom, key, sizeof(key));
+            return (cryptorand_uint64)(salt[0] ^ iv[0] ^ key[0]);
+        });
+
+        bench("cryptorand_generate_v() x3, urandom", iterations, [&]() {
+            unsigned char salt[16], iv[12], key[32];
+            cryptorand_iovec vecs[3] = {{salt, sizeof(salt)}, {iv, sizeof(iv)}, {key, sizeof(key)}};
+            cryptorand_generate_v(&urandom, vecs, 3);
+            return (cryptorand_uint64)(salt[0] ^ iv[0] ^ key[0]);
+        });
+
+        cryptorand_uninit(&urandom);
+    }
+#endif
+
+#if defined(CRYPTORAND_ARC4RANDOM_WEAK)
+    /* Only used by the stock backends on new enough versions of glibc and Linux. This shows why. */
+    if (cryptorand_arc4random_buf != NULL) {
+        bench("arc4random_buf() 16 bytes", iterations, [&]() {
+            unsigned char id[16];
+            cryptorand_arc4random_buf(id, sizeof(id));
+            return (cryptorand_uint64)id[0];
+        });
+    }
+#endif
+
+    {
+        cryptorand_cpp::engine engine;
+        bench("cryptorand_cpp::engine::generate<16>()", iterations, [&]() {
+            unsigned char id[16];
+            engine.generate(id);
+            return (cryptorand_uint64)id[0];
+        });
+    }
+
+    {
+        cryptorand buffered;
+        cryptorand_config config = cryptorand_config_init();
+        config.bufferSizeInBytes = 4096;
+        cryptorand_init_ex(&config, &buffered);
+
+        bench("cryptorand_generate() 16 bytes, buffered", iterations, [&]() {
+            unsigned char id[16];
+            cryptorand_generate(&buffered, id, sizeof(id));
+            return (cryptorand_uint64)id[0];
+        });
+
+        bench("cryptorand_generate_inline() 16 bytes", iterations, [&]() {
+            unsigned char id[16];
+            cryptorand_generate_inline(&buffered, id, sizeof(id));
+            return (cryptorand_uint64)id[0];
+        });
+
+        cryptorand_uninit(&buffered);
+    }
+
+    {
+        cryptorand_nonce_generator nonces;
+        cryptorand_nonce_generator_init(&rng, 12, &nonces);
+
+        bench("cryptorand_nonce_generator_next() 12 bytes", iterations, [&]() {
+            unsigned char nonce[12];
+            cryptorand_nonce_generator_next(&nonces, nonce);
+            return (cryptorand_uint64)nonce[11];
+        });
+
+        cryptorand_nonce_generator_uninit(&nonces);
+    }
+
+    {
+        std::random_device device;
+        bench("std::random_device", iterations, [&]() {
+            return (cryptorand_uint64)device();
+        });
+    }
+
+    cryptorand_uninit(&rng);
+
+    return 0;
+}
@@ -1,9 +1,1197 @@
+/* Bigger than PIPE_BUF so that writes to a pipe in test_write_fd() can be partial. */
+#define CRYPTORAND_WRITE_CHUNK_SIZE 16384
+
+/* Tested by test_generate_inline(). */
+#if !defined(CRYPTORAND_INLINE_FASTPATH)
+#define CRYPTORAND_INLINE_FASTPATH
+#endif
+
 #include "../cryptorand.c"
 #include <stdio.h>
+#include <string.h>
+
+static cryptorand_result on_stream_data(void* pUserData, const void* pData, size_t dataSize)
+{
+    cryptorand_uint64* pTotal = (cryptorand_uint64*)pUserData;
+
+    (void)pData;
+    *pTotal += dataSize;
+
+    return CRYPTORAND_SUCCESS;
+}
+
+/* A custom backend which just generates a counter. Useful as a test double. */
+static cryptorand_result test_backend_init(void* pUserData, cryptorand* pRNG)
+{
+    (void)pUserData;
+    (void)pRNG;
+    return CRYPTORAND_SUCCESS;
+}
+
+static cryptorand_result test_backend_generate(void* pUserData, cryptorand* pRNG, void* pBufferOut, size_t byteCount)
+{
+    unsigned char* pCounter = (unsigned char*)pUserData;
+    size_t i;
+
+    for (i = 0; i < byteCount; i += 1) {
+        ((unsigned char*)pBufferOut)[i] = *pCounter;
+        *pCounter += 1;
+    }
+
+    (void)pRNG;
+    return CRYPTORAND_SUCCESS;
+}
+
+static cryptorand_result test_backend_generate_stuck(void* pUserData, cryptorand* pRNG, void* pBufferOut, size_t byteCount)
+{
+    memset(pBufferOut, 0, byteCount);
+
+    (void)pUserData;
+    (void)pRNG;
+    return CRYPTORAND_SUCCESS;
+}
+
+static int test_custom_backend(void)
+{
+    cryptorand_backend_vtable testBackend = { test_backend_init, NULL, test_backend_generate, NULL };
+    const cryptorand_backend_vtable* pBackends[1];
+    cryptorand_config config;
+    cryptorand rng;
+    unsigned char counter = 0;
+    unsigned char pRandom[4];
+    int iAttempt;
+
+    pBackends[0] = &testBackend;
+
+    config = cryptorand_config_init();
+    config.ppCustomBackendVTables = pBackends;
+    config.customBackendCount     = 1;
+    config.pCustomBackendUserData = &counter;
+
+    if (cryptorand_init_ex(&config, &rng) != CRYPTORAND_SUCCESS) {
+        return 1;
+    }
+
+    cryptorand_generate(&rng, pRandom, sizeof(pRandom));
+    cryptorand_uninit(&rng);
+
+    if (pRandom[0] != 0 || pRandom[3] != 3) {
+        return 1;
+    }
+
+    /* A stuck source should be picked up by the health tests. */
+    testBackend.onGenerate   = test_backend_generate_stuck;
+    config.enableHealthTests = CRYPTORAND_TRUE;
+
+    if (cryptorand_init_ex(&config, &rng) != CRYPTORAND_SUCCESS) {
+        return 1;
+    }
+
+    if (cryptorand_generate(&rng, pRandom, sizeof(pRandom)) != CRYPTORAND_SUCCESS) {
+        return 1;   /* Not enough samples to fail yet. */
+    }
+
+    for (iAttempt = 0; cryptorand_generate(&rng, pRandom, sizeof(pRandom)) == CRYPTORAND_SUCCESS; iAttempt += 1) {
+        if (iAttempt > CRYPTORAND_HEALTH_RCT_CUTOFF) {
+            return 1;
+        }
+    }
+
+    cryptorand_uninit(&rng);
+
+    return 0;
+}
+
+static void on_stats(void* pUserData, const cryptorand* pRNG, const cryptorand_stats* pStats)
+{
+    (void)pRNG;
+    *(cryptorand_uint64*)pUserData = pStats->backendReadCount;
+}
+
+static int test_stats(void)
+{
+    cryptorand_config config;
+    cryptorand_stats stats;
+    cryptorand_uint64 lastReportedReadCount = 0;
+    cryptorand_uint64 timedCount = 0;
+    unsigned char pRandom[16];
+    cryptorand rng;
+    int i;
+
+    config = cryptorand_config_init();
+    config.enableLatencyHistogram = CRYPTORAND_TRUE;
+    config.onStats                = on_stats;
+    config.pStatsUserData         = &lastReportedReadCount;
+
+    if (cryptorand_init_ex(&config, &rng) != CRYPTORAND_SUCCESS) {
+        return 1;
+    }
+
+    for (i = 0; i < 3; i += 1) {
+        cryptorand_generate(&rng, pRandom, sizeof(pRandom));
+    }
+
+    cryptorand_reseed(&rng, NULL, 0);
+
+    cryptorand_get_stats(&rng, &stats);
+    cryptorand_uninit(&rng);
+
+    for (i = 0; i < CRYPTORAND_LATENCY_HISTOGRAM_SIZE; i += 1) {
+        timedCount += stats.latencyHistogram[i];
+    }
+
+    if (stats.backendReadCount != 3 || timedCount != 3 || lastReportedReadCount != 3 || stats.reseedCount != 1) {
+        return 1;
+    }
+
+    return 0;
+}
+
+static int test_buffered(void)
+{
+    unsigned char pHeap[256];
+    unsigned char pRandom[16];
+    size_t heapSizeInBytes;
+    cryptorand_config config;
+    cryptorand_stats stats;
+    cryptorand rng;
+    int i;
+
+    config = cryptorand_config_init();
+    config.bufferSizeInBytes = sizeof(pHeap);
+
+    /* The memory can be allocated by the application. */
+    if (cryptorand_get_heap_size(&config, &heapSizeInBytes) != CRYPTORAND_SUCCESS || heapSizeInBytes > sizeof(pHeap)) {
+        return 1;
+    }
+
+    if (cryptorand_init_preallocated(&config, pHeap, &rng) != CRYPTORAND_SUCCESS) {
+        return 1;
+    }
+
+    for (i = 0; i < 32; i += 1) {
+        if (cryptorand_generate(&rng, pRandom, sizeof(pRandom)) != CRYPTORAND_SUCCESS) {
+            return 1;
+        }
+    }
+
+    cryptorand_get_stats(&rng, &stats);
+    cryptorand_uninit(&rng);
+
+    if (stats.bufferRefillCount != 2 || stats.bufferHitCount != 30) {
+        return 1;
+    }
+
+    return 0;
+}
+
+static int test_generate_inline(void)
+{
+    const cryptorand_backend_vtable* pBackends[1];
+    cryptorand_backend_vtable backend;
+    unsigned char counters[2];
+    unsigned char pInline[7];
+    unsigned char pOutline[7];
+    cryptorand_config config;
+    cryptorand rngInline;
+    cryptorand rngOutline;
+    cryptorand rngLazy = CRYPTORAND_STATIC_INIT;
+    int i;
+
+    backend.onInit     = test_backend_init;
+    backend.onUninit   = NULL;
+    backend.onGenerate = test_backend_generate;
+    backend.onReseed   = NULL;
+    pBackends[0] = &backend;
+
+    /* The output stream must be the same whether or not the fast path is taken. */
+    config = cryptorand_config_init();
+    config.ppCustomBackendVTables = pBackends;
+    config.customBackendCount     = 1;
+    config.bufferSizeInBytes      = 64;
+
+    counters[0] = 0;
+    counters[1] = 0;
+
+    config.pCustomBackendUserData = &counters[0];
+    if (cryptorand_init_ex(&config, &rngInline) != CRYPTORAND_SUCCESS) {
+        return 1;
+    }
+
+    config.pCustomBackendUserData = &counters[1];
+    if (cryptorand_init_ex(&config, &rngOutline) != CRYPTORAND_SUCCESS) {
+        cryptorand_uninit(&rngInline);
+        return 1;
+    }
+
+    for (i = 0; i < 100; i += 1) {
+        size_t byteCount = (size_t)(i % 8);     /* Includes zero byte requests. */
+
+        if (cryptorand_generate_inline(&rngInline, pInline, byteCount) != cryptorand_generate(&rngOutline, pOutline, byteCount) || memcmp(pInline, pOutline, byteCount) != 0) {
+            break;
+        }
+    }
+
+    cryptorand_uninit(&rngInline);
+    cryptorand_uninit(&rngOutline);
+
+    if (i != 100) {
+        return 1;
+    }
+
+    /* Unbuffered, lazily initialized and uninitialized generators never take the fast path. */
+    if (cryptorand_generate_inline(&rngLazy, pInline, 0) != CRYPTORAND_SUCCESS || rngLazy.pBackendVTable == NULL) {
+        return 1;
+    }
+
+    cryptorand_uninit(&rngLazy);
+
+    if (cryptorand_generate_inline(&rngLazy, pInline, 0) != CRYPTORAND_INVALID_OPERATION) {
+        return 1;
+    }
+
+    return 0;
+}
+
+#if defined(CRYPTORAND_POSIX)
+#include <sys/wait.h>
+
+#define TEST_FORK_OUTPUT_SIZE   16
+
+typedef cryptorand_result (* test_fork_proc)(void* pUserData, unsigned char* pOutput);
+
+/* Runs onChild in two sibling children and returns 0 if they produced different output. */
+static int test_fork_siblings_differ(test_fork_proc onChild, void* pUserData)
+{
+    unsigned char pOutputs[2][TEST_FORK_OUTPUT_SIZE];
+    int iChild;
+
+    for (iChild = 0; iChild < 2; iChild += 1) {
+        int fds[2];
+        int status;
+        pid_t pid;
+        size_t totalRead = 0;
+
+        if (pipe(fds) != 0) {
+            return 1;
+        }
+
+        pid = fork();
+        if (pid < 0) {
+            return 1;
+        }
+
+        if (pid == 0) {
+            unsigned char pOutput[TEST_FORK_OUTPUT_SIZE];
+            close(fds[0]);
+
+            if (onChild(pUserData, pOutput) != CRYPTORAND_SUCCESS || write(fds[1], pOutput, sizeof(pOutput)) != (ssize_t)sizeof(pOutput)) {
+                _exit(1);
+            }
+
+            _exit(0);
+        }
+
+        close(fds[1]);
+
+        while (totalRead < sizeof(pOutputs[iChild])) {
+            ssize_t bytesRead = read(fds[0], pOutputs[iChild] + totalRead, sizeof(pOutputs[iChild]) - totalRead);
+            if (bytesRead <= 0) {
+                break;
+            }
+
+            totalRead += (size_t)bytesRead;
+        }
+
+        close(fds[0]);
+
+        if (waitpid(pid, &status, 0) != pid || !WIFEXITED(status) || WEXITSTATUS(status) != 0 || totalRead != sizeof(pOutputs[iChild])) {
+            return 1;
+        }
+    }
+
+    return memcmp(pOutputs[0], pOutputs[1], TEST_FORK_OUTPUT_SIZE) == 0;
+}
+
+static cryptorand_result test_fork_generate(void* pUserData, unsigned char* pOutput)
+{
+    return cryptorand_generate((cryptorand*)pUserData, pOutput, TEST_FORK_OUTPUT_SIZE);
+}
+
+static int test_fork_buffered(void)
+{
+    cryptorand_config config;
+    cryptorand rng;
+    unsigned char b;
+    int result;
+
+    config = cryptorand_config_init();
+    config.bufferSizeInBytes = 256;
+
+    /* Fill the buffer before forking so the children inherit it. */
+    if (cryptorand_init_ex(&config, &rng) != CRYPTORAND_SUCCESS || cryptorand_generate(&rng, &b, 1) != CRYPTORAND_SUCCESS) {
+        return 1;
+    }
+
+    result = test_fork_siblings_differ(test_fork_generate, &rng);
+    cryptorand_uninit(&rng);
+
+    return result;
+}
+
+#include <signal.h>
+#include <sys/time.h>
+
+#define TEST_WRITE_FD_SIZE  (256 * 1024)
+
+static volatile sig_atomic_t g_testSignalCount;
+
+static void on_test_signal(int sig)
+{
+    (void)sig;
+    g_testSignalCount += 1;
+}
+
+static int test_write_fd(void)
+{
+    struct sigaction action;
+    struct sigaction oldAction;
+    struct itimerval timer;
+    cryptorand_result result;
+    cryptorand rng;
+    int fds[2];
+    int status;
+    pid_t pid;
+
+    if (cryptorand_init(&rng) != CRYPTORAND_SUCCESS) {
+        return 1;
+    }
+
+    if (pipe(fds) != 0) {
+        cryptorand_uninit(&rng);
+        return 1;
+    }
+
+    /* A slow reader so the pipe fills up and writes block, and then complete partially when interrupted. */
+    pid = fork();
+    if (pid < 0) {
+        cryptorand_uninit(&rng);
+        return 1;
+    }
+
+    if (pid == 0) {
+        unsigned char pData[4096];
+        size_t totalRead = 0;
+
+        close(fds[1]);
+
+        for (;;) {
+            ssize_t bytesRead = read(fds[0], pData, sizeof(pData));
+            if (bytesRead < 0 && errno == EINTR) {
+                continue;
+            }
+
+            if (bytesRead <= 0) {
+                break;
+            }
+
+            totalRead += (size_t)bytesRead;
+            usleep(200);
+        }
+
+        _exit((totalRead == TEST_WRITE_FD_SIZE) ? 0 : 1);
+    }
+
+    close(fds[0]);
+
+    /* No SA_RESTART so that blocked writes are interrupted. */
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = on_test_signal;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGALRM, &action, &oldAction);
+
+    memset(&timer, 0, sizeof(timer));
+    timer.it_value.tv_usec    = 500;
+    timer.it_interval.tv_usec = 500;
+    g_testSignalCount = 0;
+    setitimer(ITIMER_REAL, &timer, NULL);
+
+    result = cryptorand_write_fd(&rng, fds[1], TEST_WRITE_FD_SIZE);
+
+    memset(&timer, 0, sizeof(timer));
+    setitimer(ITIMER_REAL, &timer, NULL);
+
+    close(fds[1]);
+    cryptorand_uninit(&rng);
+
+    while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {
+    }
+
+    sigaction(SIGALRM, &oldAction, NULL);
+
+    if (result != CRYPTORAND_SUCCESS || !WIFEXITED(status) || WEXITSTATUS(status) != 0 || g_testSignalCount == 0) {
+        return 1;
+    }
+
+    if (cryptorand_write_fd(cryptorand_default(), -1, 16) != CRYPTORAND_INVALID_ARGS) {
+        return 1;
+    }
+
+    return 0;
+}
+
+static int test_ready_fd(void)
+{
+    struct pollfd pfd;
+    int fd;
+
+    if (cryptorand_open_ready_fd(NULL) != CRYPTORAND_INVALID_ARGS || cryptorand_open_ready_fd(&fd) != CRYPTORAND_SUCCESS) {
+        return 1;
+    }
+
+    /* The sandboxes and machines we test on are well past early boot so this should be readable straight away. */
+    pfd.fd      = fd;
+    pfd.events  = POLLIN;
+    pfd.revents = 0;
+
+    if (poll(&pfd, 1, 1000) != 1 || (pfd.revents & POLLIN) == 0 || (fcntl(fd, F_GETFL) & O_NONBLOCK) == 0) {
+        close(fd);
+        return 1;
+    }
+
+    close(fd);
+
+    return 0;
+}
+
+static int test_secure_pool(void)
+{
+    cryptorand_secure_pool pool;
+    cryptorand_config config;
+    cryptorand rng[4];
+    cryptorand rngExtra;
+    unsigned char pRandom[16];
+    size_t heapSizeInBytes;
+    cryptorand_result result;
+    int i;
+
+    config = cryptorand_config_init();
+    config.bufferSizeInBytes = 256;
+
+    cryptorand_get_heap_size(&config, &heapSizeInBytes);
+
+    result = cryptorand_secure_pool_init(heapSizeInBytes, 4, &pool);
+    if (result != CRYPTORAND_SUCCESS) {
+        return (result == CRYPTORAND_OUT_OF_MEMORY || result == CRYPTORAND_ACCESS_DENIED) ? 0 : 1;   /* Not being able to lock memory is not an error with the library. */
+    }
+
+    config.allocationCallbacks = cryptorand_secure_pool_get_allocation_callbacks(&pool);
+
+    for (i = 0; i < 4; i += 1) {
+        if (cryptorand_init_ex(&config, &rng[i]) != CRYPTORAND_SUCCESS) {
+            return 1;
+        }
+
+        if (cryptorand_generate(&rng[i], pRandom, sizeof(pRandom)) != CRYPTORAND_SUCCESS) {
+            return 1;
+        }
+    }
+
+    /* The pool is full at this point. */
+    if (cryptorand_init_ex(&config, &rngExtra) != CRYPTORAND_OUT_OF_MEMORY) {
+        return 1;
+    }
+
+    for (i = 0; i < 4; i += 1) {
+        cryptorand_uninit(&rng[i]);
+    }
+
+    cryptorand_secure_pool_uninit(&pool);
+
+    return 0;
+}
+#endif
+
+static int test_distributions(void)
+{
+    static double samples[100000];
+    const size_t count = sizeof(samples) / sizeof(samples[0]);
+    double mean;
+    double variance;
+    double kurtosis;
+    size_t i;
+    cryptorand rng;
+
+    if (cryptorand_init(&rng) != CRYPTORAND_SUCCESS) {
+        return 1;
+    }
+
+    /* These bounds are about 5 standard errors wide so a correct implementation won't trip them. */
+    if (cryptorand_normal_f64_array(&rng, samples, count) != CRYPTORAND_SUCCESS) {
+        return 1;
+    }
+
+    mean = variance = kurtosis = 0;
+    for (i = 0; i < count; i += 1) {
+        mean     += samples[i];
+        variance += samples[i]*samples[i];
+        kurtosis += samples[i]*samples[i]*samples[i]*samples[i];
+    }
+    mean /= count; variance /= count; kurtosis /= count;
+
+    if (mean < -0.016 || mean > 0.016 || variance < 0.978 || variance > 1.022 || kurtosis < 2.85 || kurtosis > 3.15) {
+        return 1;
+    }
+
+    if (cryptorand_exponential_f64_array(&rng, samples, count) != CRYPTORAND_SUCCESS) {
+        return 1;
+    }
+
+    mean = variance = 0;
+    for (i = 0; i < count; i += 1) {
+        if (samples[i] < 0) {
+            return 1;
+        }
+
+        mean     += samples[i];
+        variance += (samples[i] - 1)*(samples[i] - 1);
+    }
+    mean /= count; variance /= count;
+
+    if (mean < 0.984 || mean > 1.016 || variance < 0.95 || variance > 1.05) {
+        return 1;
+    }
+
+    cryptorand_uninit(&rng);
+
+    return 0;
+}
+
+static int test_alias_table(void)
+{
+    static const double weights[5] = {1, 2, 0, 3, 4};
+    static cryptorand_uint32 indices[100000];
+    const size_t count = sizeof(indices) / sizeof(indices[0]);
+    cryptorand_uint64 pHeap[16];
+    size_t heapSizeInBytes;
+    size_t counts[5] = {0, 0, 0, 0, 0};
+    size_t i;
+    cryptorand_alias_table table;
+    cryptorand rng;
+
+    if (cryptorand_alias_table_get_heap_size(5, &heapSizeInBytes) != CRYPTORAND_SUCCESS || heapSizeInBytes > sizeof(pHeap)) {
+        return 1;
+    }
+
+    if (cryptorand_alias_table_build_preallocated(weights, 5, pHeap, &table) != CRYPTORAND_SUCCESS) {
+        return 1;
+    }
+
+    if (cryptorand_init(&rng) != CRYPTORAND_SUCCESS) {
+        return 1;
+    }
+
+    if (cryptorand_alias_sample_batch(&rng, &table, indices, count) != CRYPTORAND_SUCCESS) {
+        return 1;
+    }
+
+    for (i = 0; i < count; i += 1) {
+        if (indices[i] >= 5) {
+            return 1;
+        }
+
+        counts[indices[i]] += 1;
+    }
+
+    /* Weight i/10 of the draws should land on index i, give or take about 5 standard errors. */
+    if (counts[2] != 0) {
+        return 1;
+    }
+
+    for (i = 0; i < 5; i += 1) {
+        double expected = count * (weights[i] / 10);
+        double actual   = (double)counts[i];
+        if (actual < expected - 800 || actual > expected + 800) {
+            return 1;
+        }
+    }
+
+    cryptorand_alias_table_uninit(&table);
+
+    /* Subnormal and huge weights must not overflow while scaling. Zero weights must never be drawn. */
+    {
+        static const double extremeWeights[4][2] = {
+            {1e-310, 0}, {0, 4.9406564584124654e-324}, {1.7976931348623157e308, 0}, {1.7976931348623157e308, 1.7976931348623157e308}
+        };
+        int iCase;
+
+        for (iCase = 0; iCase < 4; iCase += 1) {
+            cryptorand_uint32 expectedZero = (extremeWeights[iCase][0] == 0) ? 0 : (extremeWeights[iCase][1] == 0) ? 1 : 2;
+
+            if (cryptorand_alias_table_build_preallocated(extremeWeights[iCase], 2, pHeap, &table) != CRYPTORAND_SUCCESS) {
+                return 1;
+            }
+
+            if (cryptorand_alias_sample_batch(&rng, &table, indices, 1000) != CRYPTORAND_SUCCESS) {
+                return 1;
+            }
+
+            for (i = 0; i < 1000; i += 1) {
+                if (indices[i] >= 2 || indices[i] == expectedZero) {
+                    return 1;
+                }
+            }
+
+            cryptorand_alias_table_uninit(&table);
+        }
+    }
+
+    cryptorand_uninit(&rng);
+
+    return 0;
+}
+
+static int test_permutation(void)
+{
+    static unsigned char seen[1000];
+    cryptorand_uint64 indices[37];
+    cryptorand_uint64 i;
+    cryptorand_permutation permutation;
+    cryptorand rng;
+
+    if (cryptorand_init(&rng) != CRYPTORAND_SUCCESS) {
+        return 1;
+    }
+
+    /* Every index should be visited exactly once. */
+    if (cryptorand_permutation_init(&rng, 1000, &permutation) != CRYPTORAND_SUCCESS) {
+        return 1;
+    }
+
+    for (i = 0; i < 1000; i += 1) {
+        cryptorand_uint64 j = cryptorand_permutation_permute(&permutation, i);
+        if (j >= 1000 || seen[j] || cryptorand_permutation_inverse(&permutation, j) != i) {
+            return 1;
+        }
+
+        seen[j] = 1;
+    }
+
+    /* The batch API needs to give the same results as the scalar one. */
+    for (i = 0; i < 37; i += 1) {
+        indices[i] = i * 27;
+    }
+
+    cryptorand_permutation_permute_batch(&permutation, indices, indices, 37);
+
+    for (i = 0; i < 37; i += 1) {
+        if (indices[i] != cryptorand_permutation_permute(&permutation, i * 27)) {
+            return 1;
+        }
+    }
+
+    /* Ranges that don't fit in a 32-bit integer. */
+    if (cryptorand_permutation_init(&rng, ((cryptorand_uint64)1 << 48) + 3, &permutation) != CRYPTORAND_SUCCESS) {
+        return 1;
+    }
+
+    for (i = 0; i < 1000; i += 1) {
+        cryptorand_uint64 j = cryptorand_permutation_permute(&permutation, i << 38);
+        if (j >= permutation.count || cryptorand_permutation_inverse(&permutation, j) != (i << 38)) {
+            return 1;
+        }
+    }
+
+    cryptorand_permutation_uninit(&permutation);
+    cryptorand_uninit(&rng);
+
+    return 0;
+}
+
+static int test_bigint(void)
+{
+    static const cryptorand_uint8 bound[3] = {0x00, 0x00, 0x05};
+    static const cryptorand_uint8 orderCurve25519[32] =
+    {
+        0x10, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+        0x14, 0xDE, 0xF9, 0xDE, 0xA2, 0xF7, 0x9C, 0xD6, 0x58, 0x12, 0x63, 0x1A, 0x5C, 0xF5, 0xD3, 0xED
+    };
+    cryptorand_uint8 value[32];
+    cryptorand_uint32 seen = 0;
+    int i;
+    int j;
+    cryptorand rng;
+
+    if (cryptorand_init(&rng) != CRYPTORAND_SUCCESS) {
+        return 1;
+    }
+
+    /* Small bounds make it easy to check that every value turns up and nothing out of range does. */
+    for (i = 0; i < 200; i += 1) {
+        if (cryptorand_bigint_below(&rng, bound, sizeof(bound), value) != CRYPTORAND_SUCCESS) {
+            return 1;
+        }
+
+        if (value[0] != 0 || value[1] != 0 || value[2] >= 5) {
+            return 1;
+        }
+
+        seen |= 1U << value[2];
+    }
+
+    if (seen != 0x1F) {
+        return 1;
+    }
+
+    /* Scalars need to be in [1, n). The top byte of the Curve25519 order means half of all candidates get rejected. */
+    for (i = 0; i < 100; i += 1) {
+        if (cryptorand_scalar_curve25519(&rng, value) != CRYPTORAND_SUCCESS) {
+            return 1;
+        }
+
+        for (j = 0; j < 32 && value[j] == orderCurve25519[j]; j += 1) {
+        }
+
+        if (j == 32 || value[j] > orderCurve25519[j]) {
+            return 1;
+        }
+    }
+
+    if (cryptorand_scalar_p256(&rng, value) != CRYPTORAND_SUCCESS || cryptorand_scalar_secp256k1(&rng, value) != CRYPTORAND_SUCCESS) {
+        return 1;
+    }
+
+    /* A bound of zero is an empty range. */
+    value[0] = 0;
+    if (cryptorand_bigint_below(&rng, value, 1, value + 1) != CRYPTORAND_INVALID_ARGS) {
+        return 1;
+    }
+
+    cryptorand_uninit(&rng);
+
+    return 0;
+}
+
+static int test_strings(void)
+{
+    static const char* words[4] = {"correct", "horse", "battery", "staple"};
+    static char code[10000];
+    char passphrase[64];
+    size_t counts[10] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+    size_t i;
+    double entropyBits;
+    cryptorand rng;
+
+    if (cryptorand_init(&rng) != CRYPTORAND_SUCCESS) {
+        return 1;
+    }
+
+    /* Digits only. Each should come up about as often as the others. */
+    if (cryptorand_string(&rng, "0123456789", 10, code, sizeof(code)) != CRYPTORAND_SUCCESS) {
+        return 1;
+    }
+
+    for (i = 0; i < sizeof(code); i += 1) {
+        if (code[i] < '0' || code[i] > '9') {
+            return 1;
+        }
+
+        counts[code[i] - '0'] += 1;
+    }
+
+    for (i = 0; i < 10; i += 1) {
+        if (counts[i] < 850 || counts[i] > 1150) {
+            return 1;
+        }
+    }
+
+    /* Four words from a list of four is 8 bits. */
+    if (cryptorand_passphrase(&rng, words, 4, 4, "-", passphrase, sizeof(passphrase), &entropyBits) != CRYPTORAND_SUCCESS) {
+        return 1;
+    }
+
+    if (entropyBits < 7.999 || entropyBits > 8.001 || strlen(passphrase) < 4*5 + 3) {
+        return 1;
+    }
+
+    if (cryptorand_passphrase(&rng, words, 4, 4, "-", passphrase, 16, NULL) != CRYPTORAND_TOO_BIG) {
+        return 1;
+    }
+
+    cryptorand_uninit(&rng);
+
+    return 0;
+}
+
+static int test_nonce_generator(void)
+{
+    cryptorand_uint8 nonce[3][12];
+    cryptorand_uint8 longNonce[24];
+    cryptorand_nonce_generator generator;
+    cryptorand rng;
+
+    if (cryptorand_init(&rng) != CRYPTORAND_SUCCESS) {
+        return 1;
+    }
+
+    if (cryptorand_nonce_generator_init(&rng, 12, &generator) != CRYPTORAND_SUCCESS) {
+        return 1;
+    }
+
+    /* The prefix stays the same and the counter goes up. */
+    if (cryptorand_nonce_generator_next(&generator, nonce[0]) != CRYPTORAND_SUCCESS || cryptorand_nonce_generator_next(&generator, nonce[1]) != CRYPTORAND_SUCCESS) {
+        return 1;
+    }
+
+    if (memcmp(nonce[0], nonce[1], 8) != 0 || memcmp(nonce[0] + 8, "\0\0\0\0", 4) != 0 || memcmp(nonce[1] + 8, "\0\0\0\1", 4) != 0) {
+        return 1;
+    }
+
+    /* The last nonce before the counter runs out, and then a new prefix. */
+    generator.counter = generator.counterLimit - 1;
+    if (cryptorand_nonce_generator_next(&generator, nonce[1]) != CRYPTORAND_SUCCESS || cryptorand_nonce_generator_next(&generator, nonce[2]) != CRYPTORAND_SUCCESS) {
+        return 1;
+    }
+
+    if (memcmp(nonce[0], nonce[1], 8) != 0 || memcmp(nonce[1] + 8, "\xFF\xFF\xFF\xFF", 4) != 0) {
+        return 1;
+    }
+
+    if (memcmp(nonce[0], nonce[2], 8) == 0 || memcmp(nonce[2] + 8, "\0\0\0\0", 4) != 0) {
+        return 1;
+    }
+
+    cryptorand_nonce_generator_uninit(&generator);
+
+    /* 24-byte nonces for XChaCha20-Poly1305. */
+    if (cryptorand_nonce_generator_init(&rng, 24, &generator) != CRYPTORAND_SUCCESS || cryptorand_nonce_generator_next(&generator, longNonce) != CRYPTORAND_SUCCESS) {
+        return 1;
+    }
+
+    if (memcmp(longNonce + 16, "\0\0\0\0\0\0\0\0", 8) != 0) {
+        return 1;
+    }
+
+    cryptorand_nonce_generator_uninit(&generator);
+
+    if (cryptorand_nonce_generator_init(&rng, 16, &generator) != CRYPTORAND_INVALID_ARGS) {
+        return 1;
+    }
+
+    cryptorand_uninit(&rng);
+
+    return 0;
+}
+
+#if defined(CRYPTORAND_POSIX)
+static cryptorand_result test_fork_nonce(void* pUserData, unsigned char* pOutput)
+{
+    memset(pOutput, 0, TEST_FORK_OUTPUT_SIZE);
+    return cryptorand_nonce_generator_next((cryptorand_nonce_generator*)pUserData, pOutput);
+}
+
+/* Pre-forked workers sharing a nonce generator set up in the parent must not reuse nonces. */
+static int test_fork_nonce_generator(void)
+{
+    cryptorand_nonce_generator generator;
+    unsigned char nonce[12];
+    cryptorand rng;
+    int result;
+
+    if (cryptorand_init(&rng) != CRYPTORAND_SUCCESS || cryptorand_nonce_generator_init(&rng, 12, &generator) != CRYPTORAND_SUCCESS) {
+        return 1;
+    }
+
+    cryptorand_nonce_generator_next(&generator, nonce);
+
+    result = test_fork_siblings_differ(test_fork_nonce, &generator);
+
+    cryptorand_nonce_generator_uninit(&generator);
+    cryptorand_uninit(&rng);
+
+    return result;
+}
+#endif
+
+static int test_derive(void)
+{
+    unsigned char pRandom[16];
+    cryptorand_config config;
+    cryptorand_stats stats;
+    cryptorand parent;
+    cryptorand child;
+    cryptorand grandchild;
+
+    if (cryptorand_init(&parent) != CRYPTORAND_SUCCESS) {
+        return 1;
+    }
+
+    config = cryptorand_config_init();
+    config.bufferSizeInBytes = 64;
+
+    if (cryptorand_derive(&parent, &config, &child) != CRYPTORAND_SUCCESS || cryptorand_derive(&child, NULL, &grandchild) != CRYPTORAND_SUCCESS) {
+        return 1;
+    }
+
+    /* Children keep their own statistics. */
+    if (cryptorand_generate(&child, pRandom, sizeof(pRandom)) != CRYPTORAND_SUCCESS || cryptorand_generate(&child, pRandom, sizeof(pRandom)) != CRYPTORAND_SUCCESS) {
+        return 1;
+    }
+
+    cryptorand_get_stats(&child, &stats);
+    if (stats.bufferRefillCount != 1 || stats.bufferHitCount != 1) {
+        return 1;
+    }
+
+    cryptorand_get_stats(&parent, &stats);
+    if (stats.generateCount != 0) {
+        return 1;
+    }
+
+    /* Uninitializing a child must leave the parent's backend alone. */
+    cryptorand_uninit(&child);
+
+    if (cryptorand_generate(&grandchild, pRandom, sizeof(pRandom)) != CRYPTORAND_SUCCESS || cryptorand_generate(&parent, pRandom, sizeof(pRandom)) != CRYPTORAND_SUCCESS) {
+        return 1;
+    }
+
+    cryptorand_uninit(&grandchild);
+    cryptorand_uninit(&parent);
+
+    /* There's nothing to share once the parent has been uninitialized. */
+    if (cryptorand_derive(&parent, NULL, &child) != CRYPTORAND_INVALID_OPERATION || cryptorand_derive(&grandchild, NULL, &child) != CRYPTORAND_INVALID_OPERATION) {
+        return 1;
+    }
+
+    return 0;
+}
+
+static int test_lazy_init(void)
+{
+    unsigned char pRandom[16];
+    cryptorand_stats stats;
+    cryptorand rng = CRYPTORAND_STATIC_INIT;
+    cryptorand child;
+
+    /* Nothing is set up until the first request. */
+    if (rng.pBackendVTable != NULL) {
+        return 1;
+    }
+
+    if (cryptorand_generate(&rng, pRandom, sizeof(pRandom)) != CRYPTORAND_SUCCESS || rng.pBackendVTable == NULL) {
+        return 1;
+    }
+
+    cryptorand_get_stats(&rng, &stats);
+    if (stats.generateCount != 1 || stats.bytesGenerated != sizeof(pRandom)) {
+        return 1;
+    }
+
+    cryptorand_uninit(&rng);
+
+    /* Using a generator after uninitializing it is an error rather than a silent reinitialization. */
+    if (cryptorand_generate(&rng, pRandom, sizeof(pRandom)) != CRYPTORAND_INVALID_OPERATION || cryptorand_init(&rng) != CRYPTORAND_SUCCESS) {
+        return 1;
+    }
+
+    cryptorand_uninit(&rng);
+
+    /* The default generator is always the same instance. */
+    if (cryptorand_default() != cryptorand_default() || cryptorand_generate(cryptorand_default(), pRandom, sizeof(pRandom)) != CRYPTORAND_SUCCESS) {
+        return 1;
+    }
+
+    if (cryptorand_derive(cryptorand_default(), NULL, &child) != CRYPTORAND_SUCCESS || cryptorand_generate(&child, pRandom, sizeof(pRandom)) != CRYPTORAND_SUCCESS) {
+        return 1;
+    }
+
+    cryptorand_uninit(&child);
+
+    return 0;
+}
+
+/* Records the total size of the input passed to onReseed. */
+static cryptorand_result test_backend_reseed(void* pUserData, cryptorand* pRNG, const void* pAdditionalInput, size_t additionalInputSize)
+{
+    (void)pRNG;
+    (void)pAdditionalInput;
+    *(size_t*)pUserData += additionalInputSize + 1;
+    return CRYPTORAND_SUCCESS;
+}
+
+static cryptorand_result test_backend_generate_zero(void* pUserData, cryptorand* pRNG, void* pBufferOut, size_t byteCount)
+{
+    (void)pUserData;
+    (void)pRNG;
+    memset(pBufferOut, 0, byteCount);
+    return CRYPTORAND_SUCCESS;
+}
+
+static int test_reseed(void)
+{
+    cryptorand_backend_vtable testBackend = { test_backend_init, NULL, test_backend_generate_zero, test_backend_reseed };
+    const cryptorand_backend_vtable* pBackends[1];
+    unsigned char pAdditionalInput[32] = {0};
+    unsigned char pRandom[16];
+    size_t reseedInputSize = 0;
+    cryptorand_config config;
+    cryptorand_stats stats;
+    cryptorand rng;
+
+    pBackends[0] = &testBackend;
+
+    config = cryptorand_config_init();
+    config.ppCustomBackendVTables     = pBackends;
+    config.customBackendCount         = 1;
+    config.pCustomBackendUserData     = &reseedInputSize;
+    config.bufferSizeInBytes          = 256;
+    config.pPersonalization           = "test";
+    config.personalizationSizeInBytes = 4;
+
+    /* The personalization string is handed to the backend at init time. */
+    if (cryptorand_init_ex(&config, &rng) != CRYPTORAND_SUCCESS || reseedInputSize != 5) {
+        return 1;
+    }
+
+    cryptorand_generate(&rng, pRandom, sizeof(pRandom));
+
+    if (cryptorand_reseed(&rng, pAdditionalInput, sizeof(pAdditionalInput)) != CRYPTORAND_SUCCESS || reseedInputSize != 5 + 33) {
+        return 1;
+    }
+
+    /* The buffer should have been discarded so the next request needs a refill. */
+    cryptorand_generate(&rng, pRandom, sizeof(pRandom));
+    cryptorand_get_stats(&rng, &stats);
+    if (stats.bufferRefillCount != 2) {
+        return 1;
+    }
+
+    /* Prediction resistant requests never come out of the buffer. */
+    cryptorand_generate_ex(&rng, pRandom, sizeof(pRandom), CRYPTORAND_GENERATE_PREDICTION_RESISTANCE);
+    cryptorand_get_stats(&rng, &stats);
+    if (stats.backendReadCount != 3 || stats.bufferHitCount != 0) {
+        return 1;
+    }
+
+    /* Reseeding a derived generator goes to the backend of the parent. */
+    {
+        cryptorand child;
+
+        if (cryptorand_derive(&rng, NULL, &child) != CRYPTORAND_SUCCESS || cryptorand_reseed(&child, NULL, 0) != CRYPTORAND_SUCCESS || reseedInputSize != 5 + 33 + 1) {
+            return 1;
+        }
+
+        cryptorand_uninit(&child);
+    }
+
+    cryptorand_uninit(&rng);
+
+    return 0;
+}
+
+#if defined(CRYPTORAND_POSIX)
+static cryptorand_result test_fork_prediction_resistance(void* pUserData, unsigned char* pOutput)
+{
+    return cryptorand_generate_ex((cryptorand*)pUserData, pOutput, TEST_FORK_OUTPUT_SIZE, CRYPTORAND_GENERATE_PREDICTION_RESISTANCE);
+}
+
+/* Prediction resistant output must not come from anything buffered before the fork, including in the backend. */
+static int test_fork_reseed(void)
+{
+    cryptorand rng;
+    unsigned char b;
+    int result;
+
+    if (cryptorand_init(&rng) != CRYPTORAND_SUCCESS || cryptorand_generate_ex(&rng, &b, 1, CRYPTORAND_GENERATE_PREDICTION_RESISTANCE) != CRYPTORAND_SUCCESS) {
+        return 1;
+    }
+
+    result = test_fork_siblings_differ(test_fork_prediction_resistance, &rng);
+    cryptorand_uninit(&rng);
+
+    return result;
+}
+#endif
+
+static int test_generate_v(void)
+{
+    cryptorand_backend_vtable testBackend = { test_backend_init, NULL, test_backend_generate, NULL };
+    const cryptorand_backend_vtable* pBackends[1];
+    unsigned char pSalt[3];
+    unsigned char pIV[5];
+    unsigned char pBig[CRYPTORAND_GENERATE_V_BLOCK_SIZE];
+    unsigned char pTag[2];
+    cryptorand_iovec pVecs[5];
+    unsigned char counter = 0;
+    cryptorand_config config;
+    cryptorand_stats stats;
+    cryptorand rng;
+
+    pBackends[0] = &testBackend;
+
+    config = cryptorand_config_init();
+    config.ppCustomBackendVTables = pBackends;
+    config.customBackendCount     = 1;
+    config.pCustomBackendUserData = &counter;
+
+    if (cryptorand_init_ex(&config, &rng) != CRYPTORAND_SUCCESS) {
+        return 1;
+    }
+
+    pVecs[0].pData = pSalt; pVecs[0].size = sizeof(pSalt);
+    pVecs[1].pData = NULL;  pVecs[1].size = 0;
+    pVecs[2].pData = pIV;   pVecs[2].size = sizeof(pIV);
+    pVecs[3].pData = pBig;  pVecs[3].size = sizeof(pBig);
+    pVecs[4].pData = pTag;  pVecs[4].size = sizeof(pTag);
+
+    if (cryptorand_generate_v(&rng, pVecs, 5) != CRYPTORAND_SUCCESS) {
+        return 1;
+    }
+
+    /* The salt and IV share a backend call. The big buffer is read directly. */
+    cryptorand_get_stats(&rng, &stats);
+    if (stats.backendReadCount != 3 || stats.bytesGenerated != sizeof(pSalt) + sizeof(pIV) + sizeof(pBig) + sizeof(pTag)) {
+        return 1;
+    }
+
+    if (pSalt[0] != 0 || pSalt[2] != 2 || pIV[0] != 3 || pIV[4] != 7 || pBig[0] != 8 || pTag[0] != (unsigned char)(8 + sizeof(pBig))) {
+        return 1;
+    }
+
+    cryptorand_uninit(&rng);
+
+    /* Buffered generators serve each buffer out of the internal buffer. A call counts as one hit. */
+    config = cryptorand_config_init();
+    config.bufferSizeInBytes = 64;
+
+    if (cryptorand_init_ex(&config, &rng) != CRYPTORAND_SUCCESS || cryptorand_generate_v(&rng, pVecs, 5) != CRYPTORAND_SUCCESS) {
+        return 1;
+    }
+
+    pVecs[3].size = 0;
+    if (cryptorand_generate_v(&rng, pVecs, 5) != CRYPTORAND_SUCCESS) {
+        return 1;
+    }
+
+    cryptorand_get_stats(&rng, &stats);
+    if (stats.bufferHitCount != 1) {
+        return 1;
+    }
+
+    cryptorand_uninit(&rng);
+
+    return 0;
+}
+
+#if defined(__cplusplus) && __cplusplus >= 201103L
+static int test_cpp_engine(void);   /* Implemented in cryptorand_test.cpp. */
+#endif
 
 int main(int argc, char** argv)
 {
     unsigned char pRandom[64] = {0};
+    cryptorand_uint64 streamedByteCount = 0;
+    cryptorand_stats stats;
 
     /* Initialize the random number generator first. */
     cryptorand rng;
@@ -11,10 +1199,159 @@ int main(int argc, char** argv)
 
     /* Now generate some random content. */
     cryptorand_generate(&rng, pRandom, sizeof(pRandom));
+    CRYPTORAND_GENERATE_OBJECT(&rng, &pRandom);
+
+    /* Big outputs can be streamed through a callback in chunks. */
+    if (cryptorand_generate_stream(&rng, CRYPTORAND_STREAM_CHUNK_SIZE*3 + 17, on_stream_data, &streamedByteCount) != CRYPTORAND_SUCCESS || streamedByteCount != CRYPTORAND_STREAM_CHUNK_SIZE*3 + 17) {
+        printf("cryptorand_generate_stream() failed.\n");
+        return 1;
+    }
+
+    /* Statistics are tracked per generator. */
+    cryptorand_get_stats(&rng, &stats);
+    if (stats.bytesGenerated != sizeof(pRandom)*2 + streamedByteCount) {
+        printf("cryptorand_get_stats() returned unexpected results.\n");
+        return 1;
+    }
 
     /* Destroy the random number generator when we're done with it. */
     cryptorand_uninit(&rng);
 
+    /* Backend latency can be tracked and the counters exported through a callback. */
+    if (test_stats() != 0) {
+        printf("Statistics failed.\n");
+        return 1;
+    }
+
+    /* Small requests can be served from an internal buffer. */
+    if (test_buffered() != 0) {
+        printf("Buffered generation failed.\n");
+        return 1;
+    }
+
+#if defined(CRYPTORAND_POSIX)
+    /* Forked children must never hand out the same bytes. */
+    if (test_fork_buffered() != 0) {
+        printf("Buffered generation after fork() failed.\n");
+        return 1;
+    }
+
+    /* Random data can be written straight to a descriptor, even when writes are partial or interrupted. */
+    if (test_write_fd() != 0) {
+        printf("Writing to a file descriptor failed.\n");
+        return 1;
+    }
+
+    if (test_ready_fd() != 0) {
+        printf("Readiness descriptor failed.\n");
+        return 1;
+    }
+
+    /* Generators can be placed in locked memory. */
+    if (test_secure_pool() != 0) {
+        printf("Secure pool failed.\n");
+        return 1;
+    }
+#endif
+
+    /* Normal and exponential samples should have the right moments. */
+    if (test_distributions() != 0) {
+        printf("Distributions failed.\n");
+        return 1;
+    }
+
+    /* Weighted selection with an alias table. */
+    if (test_alias_table() != 0) {
+        printf("Alias table failed.\n");
+        return 1;
+    }
+
+    /* Random orderings of huge ranges without storing them. */
+    if (test_permutation() != 0) {
+        printf("Permutation failed.\n");
+        return 1;
+    }
+
+    /* Big integers below a bound, such as elliptic curve scalars. */
+    if (test_bigint() != 0) {
+        printf("Big integers failed.\n");
+        return 1;
+    }
+
+    /* Strings from custom alphabets and passphrases. */
+    if (test_strings() != 0) {
+        printf("Strings failed.\n");
+        return 1;
+    }
+
+    /* Unique nonces without going to the backend each time. */
+    if (test_nonce_generator() != 0) {
+        printf("Nonce generator failed.\n");
+        return 1;
+    }
+
+#if defined(CRYPTORAND_POSIX)
+    if (test_fork_nonce_generator() != 0) {
+        printf("Nonce generator after fork() failed.\n");
+        return 1;
+    }
+#endif
+
+    /* Cheap generators that share a backend. */
+    if (test_derive() != 0) {
+        printf("Derived generators failed.\n");
+        return 1;
+    }
+
+    /* Generators can be initialized on first use. */
+    if (test_lazy_init() != 0) {
+        printf("Lazy initialization failed.\n");
+        return 1;
+    }
+
+    /* The sandboxes and machines we test on are well past early boot. */
+    if (!cryptorand_is_ready() || cryptorand_wait_ready(0) != CRYPTORAND_SUCCESS || cryptorand_wait_ready(100) != CRYPTORAND_SUCCESS) {
+        printf("Entropy readiness check failed.\n");
+        return 1;
+    }
+
+    /* Fresh entropy can be forced after sensitive events. */
+    if (test_reseed() != 0) {
+        printf("Reseed failed.\n");
+        return 1;
+    }
+
+#if defined(CRYPTORAND_POSIX)
+    if (test_fork_reseed() != 0) {
+        printf("Prediction resistance after fork() failed.\n");
+        return 1;
+    }
+#endif
+
+    /* Several buffers can be filled with one call. */
+    if (test_generate_v() != 0) {
+        printf("Vectored generation failed.\n");
+        return 1;
+    }
+
+    /* Custom backends can be plugged in at initialization time. */
+    if (test_custom_backend() != 0) {
+        printf("Custom backend failed.\n");
+        return 1;
+    }
+
+    if (test_generate_inline() != 0) {
+        printf("Inline generation failed.\n");
+        return 1;
+    }
+
+#if defined(__cplusplus) && __cplusplus >= 201103L
+    if (test_cpp_engine() != 0) {
+        printf("C++ engine failed.\n");
+        return 1;
+    }
+#endif
+
     (void)argc;
     (void)argv;
 
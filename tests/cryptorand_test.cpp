@@ -1 +1,40 @@
 #include "cryptorand_test.c"
+
+#if __cplusplus >= 201103L
+#include <random>
+#include <algorithm>
+#include <vector>
+
+/* The C++ engine should work with the standard library's distributions and algorithms. */
+static int test_cpp_engine(void)
+{
+    cryptorand_cpp::engine rng;
+    std::uniform_int_distribution<int> dist(1, 6);
+    std::vector<int> values(100);
+
+    for (size_t i = 0; i < values.size(); i += 1) {
+        values[i] = dist(rng);
+        if (values[i] < 1 || values[i] > 6) {
+            return 1;
+        }
+    }
+
+    std::shuffle(values.begin(), values.end(), rng);
+
+    /* Fixed size generation. */
+    {
+        unsigned char nonce[12];
+        struct id { cryptorand_uint64 hi; cryptorand_uint64 lo; };
+
+        rng.generate(nonce);
+        rng.generate<id>();
+    }
+
+    cryptorand_cpp::engine moved(std::move(rng));
+    moved();
+    moved.reseed();
+    moved();
+
+    return 0;
+}
+#endif